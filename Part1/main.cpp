@@ -1,18 +1,85 @@
 #include <cassert>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <algorithm>
-#include <filesystem>
+#include <cstdlib>
 
 #include "sim8086.h"
+#include "sim8086_batch.h"
+#include "sim8086_biu.h"
+#include "sim8086_blocks.h"
 #include "sim8086_decoder.h"
-
+#include "sim8086_dump.h"
 #include "sim8086_estimation.h"
-#include "sim8086_estimation.cpp"
-
+#include "sim8086_jit.h"
+#include "sim8086_loader.h"
+#include "sim8086_lockstep.h"
+#include "sim8086_profile.h"
+#include "sim8086_snapshot.h"
+#include "sim8086_timetravel.h"
+#include "sim8086_tracebin.h"
 #include "sim8086_text.h"
-#include "sim8086_text.cpp"
+#include "sim8086_translate.h"
 
+// -sweep: reg starts at start in lane 0 and step more in every lane after.
+struct RegisterSweep
+{
+    Register reg = Register::reg_none;
+    uint16_t start = 0;
+    uint16_t step = 1;
+};
+
+// -lockstep runs the program in laneCount lanes at once and reports every lane like -exec would.
+template <size_t laneCount>
+static void RunLockstep(const VirtualChip& chip, const std::vector<RegisterSweep>& sweeps, uint64_t instructionBudget, const char* programName)
+{
+    LockstepEngine<laneCount> engine(chip.m_program, chip.m_programSize, chip.cpuTarget);
+    engine.instructionLimit = instructionBudget;
+
+    for (size_t lane{ 0 }; lane < laneCount; ++lane)
+    {
+        for (const RegisterSweep& sweep : sweeps)
+        {
+            engine.SetRegister(lane, sweep.reg, static_cast<uint16_t>(sweep.start + lane * sweep.step));
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    engine.Run();
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    TextSpace::TraceWriter trace{};
+    trace.Write(programName);
+    trace.Write(" lockstep execution, ");
+    trace.Decimal(static_cast<int64_t>(laneCount));
+    trace.Write(" lanes\n");
+
+    uint64_t laneInstructions = 0;
+    for (size_t lane{ 0 }; lane < laneCount; ++lane)
+    {
+        TextSpace::WriteFinalRegisters(trace, engine.LaneState(lane), "Lane " + std::to_string(lane) + " registers");
+
+        trace.Write("  instructions: ");
+        trace.Decimal(static_cast<int64_t>(engine.LaneInstructions(lane)));
+        trace.Write(", clocks: ");
+        trace.Decimal(engine.LaneClocks(lane));
+        trace.Write('\n');
+
+        laneInstructions += engine.LaneInstructions(lane);
+    }
+
+    trace.Flush();
+
+    std::cout << "\nIssued: " << engine.instructionsIssued <<
+        (engine.instructionsIssued >= instructionBudget ? " (stopped at the -limit budget)" : "") <<
+        "\nLane instructions: " << laneInstructions <<
+        "\nWall time: " << std::fixed << std::setprecision(6) << wallSeconds << " s" <<
+        "\nGuest MIPS: " << std::setprecision(2) << (wallSeconds > 0.0 ? static_cast<double>(laneInstructions) / wallSeconds / 1e6 : 0.0) << '\n';
+}
 
 int main(int argc, char* argv[])
 {
@@ -21,214 +88,534 @@ int main(int argc, char* argv[])
 
     std::ofstream outf{};
 
+    bool bPrintCacheStats = false;
+    bool bThreaded = false;
+    bool bJit = false;
+    bool bBusModel = false;
+    const char* outFilePath = nullptr;
+    const char* translatePath = nullptr;
+    const char* traceBinPath = nullptr;
+    const char* profileCsvPath = nullptr;
+    const char* profileFoldedPath = nullptr;
+    bool bProfile = false;
+    bool bRun = false;
+    bool bBatch = false;
+    const char* batchOutPath = "sim8086_batch";
+    size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    size_t lockstepLanes = 0;
+    std::vector<RegisterSweep> sweeps{};
+
+    DumpFormat dumpFormat = DumpFormat::raw;
+    uint64_t dumpEvery = 0;
+    uint64_t repeatCount = 1;
+    uint64_t instructionBudget = UINT64_MAX;
+    std::vector<uint64_t> seekPositions{};
+
+    // Everything the simulation works on.
+    VirtualChip chip{};
+
     // set execution type and read binary file.
-    if (argc > 2)
+    ExecutionType executionType = ExecutionType::print;
+
+    for (int i{ 1 }; i < argc - 1; ++i)
     {
-        
-        const std::string arg = std::string(argv[1]);
+        const std::string arg = std::string(argv[i]);
         if (arg == "-exec")
         {
-            Decoder::executionType = ExecutionType::simulate;            
+            executionType = ExecutionType::simulate;            
         }
         else if (arg == "-dump")
         {
-            Decoder::executionType = ExecutionType::dump;
+            executionType = ExecutionType::dump;
+        }
+        else if (arg == "-dumpformat" && i + 1 < argc - 1)
+        {
+            const std::string format = std::string(argv[++i]);
+            dumpFormat = format == "sparse" ? DumpFormat::sparse : format == "compressed" ? DumpFormat::compressed : DumpFormat::raw;
+        }
+        else if (arg == "-dumpevery" && i + 1 < argc - 1)
+        {
+            dumpEvery = std::strtoull(argv[++i], nullptr, 0);
         }
         else if (arg == "-showclocks")
         {
-            Decoder::executionType = ExecutionType::showClocks;
+            executionType = ExecutionType::showClocks;
         }
         else if (arg == "-explainclocks")
         {
-            Decoder::executionType = ExecutionType::explainClocks;
+            executionType = ExecutionType::explainClocks;
+        }
+        else if (arg == "-cpu" && i + 1 < argc - 1)
+        {
+            chip.cpuTarget = std::string(argv[++i]) == "8088" ? Estimator::CpuTarget::i8088 : Estimator::CpuTarget::i8086;
+        }
+        else if (arg == "-biu")
+        {
+            bBusModel = true;
+        }
+        else if (arg == "-cachestats")
+        {
+            bPrintCacheStats = true;
+        }
+        else if (arg == "-threaded")
+        {
+            bThreaded = true;
+        }
+        else if (arg == "-jit")
+        {
+            bThreaded = true;
+            bJit = true;
+        }
+        else if (arg == "-repeat" && i + 1 < argc - 1)
+        {
+            bThreaded = true;
+            repeatCount = std::max<uint64_t>(std::strtoull(argv[++i], nullptr, 0), 1);
+        }
+        else if (arg == "-run")
+        {
+            bRun = true;
+            bThreaded = true;
+        }
+        else if (arg == "-batch")
+        {
+            bBatch = true;
+        }
+        else if (arg == "-batch-out" && i + 1 < argc - 1)
+        {
+            batchOutPath = argv[++i];
+        }
+        else if (arg == "-threads" && i + 1 < argc - 1)
+        {
+            threadCount = std::max<size_t>(std::strtoull(argv[++i], nullptr, 0), 1);
+        }
+        else if (arg == "-lockstep" && i + 1 < argc - 1)
+        {
+            // The lanes of an SSE register or of an AVX2 one.
+            lockstepLanes = std::strtoull(argv[++i], nullptr, 0);
+            if (lockstepLanes != 8 && lockstepLanes != 16)
+            {
+                std::cout << "-lockstep runs 8 or 16 lanes, not " << argv[i] << '\n';
+                return -1;
+            }
+        }
+        else if (arg == "-sweep" && i + 1 < argc - 1)
+        {
+            // reg=start[:step] separated by commas.
+            std::istringstream specs(argv[++i]);
+            for (std::string spec{}; std::getline(specs, spec, ','); )
+            {
+                RegisterSweep sweep{};
+                const auto name = std::find(Decoder::reg_rm_word.begin(), Decoder::reg_rm_word.end(), spec.substr(0, spec.find('=')));
+                if (name == Decoder::reg_rm_word.end() || spec.find('=') == std::string::npos)
+                {
+                    std::cout << "Unknown sweep " << spec << '\n';
+                    return -1;
+                }
+
+                char* end = nullptr;
+                sweep.reg = static_cast<Register>(name - Decoder::reg_rm_word.begin());
+                sweep.start = static_cast<uint16_t>(std::strtol(spec.c_str() + spec.find('=') + 1, &end, 0));
+                if (*end == ':')
+                {
+                    sweep.step = static_cast<uint16_t>(std::strtol(end + 1, nullptr, 0));
+                }
+
+                sweeps.push_back(sweep);
+            }
+        }
+        else if (arg == "-limit" && i + 1 < argc - 1)
+        {
+            instructionBudget = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (arg == "-seek" && i + 1 < argc - 1)
+        {
+            // Instruction counts separated by commas, in the order to visit them.
+            for (char* position = argv[++i]; *position; )
+            {
+                seekPositions.push_back(std::strtoull(position, &position, 0));
+                position += *position == ',';
+            }
+        }
+        else if (arg == "-translate" && i + 1 < argc - 1)
+        {
+            translatePath = argv[++i];
+        }
+        else if (arg == "-trace-bin" && i + 1 < argc - 1)
+        {
+            traceBinPath = argv[++i];
+        }
+        else if (arg == "-profile")
+        {
+            bProfile = true;
+        }
+        else if (arg == "-profile-csv" && i + 1 < argc - 1)
+        {
+            bProfile = true;
+            profileCsvPath = argv[++i];
+        }
+        else if (arg == "-profile-folded" && i + 1 < argc - 1)
+        {
+            bProfile = true;
+            profileFoldedPath = argv[++i];
         }
         else
         {
-            Decoder::executionType = ExecutionType::outFile;
+            executionType = ExecutionType::outFile;
+            outFilePath = argv[i];
         }
     }
-    else
+
+    if (!sweeps.empty() && lockstepLanes == 0)
     {
-        Decoder::executionType = ExecutionType::print;
+        std::cout << "-sweep sets up the lanes of -lockstep, which is missing\n";
+        return -1;
+    }
+
+    const bool bTraceBin = traceBinPath != nullptr;
+
+    // Time travel, the bus model, the profiler and -trace-bin follow the stepping simulator, blocks don't stop between instructions.
+    if (!seekPositions.empty() || bBusModel || bProfile || bTraceBin)
+    {
+        bThreaded = false;
+    }
+
+    // The bus model is reported next to the estimate, the profiler and -run add estimates up.
+    if ((bBusModel || bProfile || (bRun && !bThreaded)) && executionType < ExecutionType::showClocks)
+    {
+        executionType = ExecutionType::showClocks;
+    }
+
+    if ((bThreaded || bTraceBin || !seekPositions.empty()) && executionType < ExecutionType::simulate)
+    {
+        executionType = ExecutionType::simulate;
     }
 
-    std::ifstream inf{ argv[argc - 1] };
-    if (!inf)
+    // -batch takes a directory or a list of programs instead of one, and runs them side by side like -run.
+    if (bBatch)
+    {
+        const std::vector<std::string> programs = BatchRunner::ListPrograms(argv[argc - 1]);
+        if (programs.empty())
+        {
+            std::cout << argv[argc - 1] << " names no programs to run!";
+            return -1;
+        }
+
+        BatchRunner batchRunner(threadCount);
+        batchRunner.bJit = bJit;
+        batchRunner.instructionLimit = instructionBudget;
+        batchRunner.cpuTarget = chip.cpuTarget;
+
+        const auto startTime = std::chrono::steady_clock::now();
+        const std::vector<BatchResult> results = batchRunner.Run(programs, batchOutPath);
+        const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        uint64_t totalInstructions = 0;
+        size_t failures = 0;
+        for (size_t job{ 0 }; job < programs.size(); ++job)
+        {
+            const BatchResult& result = results[job];
+            std::cout << programs[job] << ": ";
+
+            if (!result.bLoaded || !result.bWritten)
+            {
+                std::cout << (result.bLoaded ? "result could not be written!\n" : "could not be opened for reading!\n");
+                ++failures;
+                continue;
+            }
+
+            totalInstructions += result.instructions;
+            std::cout << result.instructions << " instructions, " << result.clocks << " clocks, " <<
+                std::fixed << std::setprecision(6) << result.seconds << " s\n";
+        }
+
+        std::cout << "\n" << programs.size() << " programs on " << std::min(threadCount, programs.size()) << " threads, results in " <<
+            batchOutPath << "\nInstructions: " << totalInstructions << "\nWall time: " << std::fixed << std::setprecision(6) << wallSeconds <<
+            " s\nGuest MIPS: " << std::setprecision(2) << (wallSeconds > 0.0 ? static_cast<double>(totalInstructions) / wallSeconds / 1e6 : 0.0) << '\n';
+
+        return failures == 0 ? 0 : -1;
+    }
+
+    ProgramImage program{};
+    if (!program.Open(argv[argc - 1]))
     {
         std::cout << argv[argc - 1] << " could not be opened for reading!";
         return -1;
     }
 
-    std::vector<uint32_t> buffer{ std::istreambuf_iterator<char>(inf), {} };
-    uint32_t bufferSize = static_cast<uint32_t>(buffer.size());
-    uint32_t* binaryInstructionStream = buffer.data();
+    chip.m_program = program.Data();
+    chip.m_programSize = program.Size();
+
+    if (lockstepLanes == 8)
+    {
+        RunLockstep<8>(chip, sweeps, instructionBudget, argv[argc - 1]);
+        return 0;
+    }
 
-    switch (Decoder::executionType)
+    if (lockstepLanes == 16)
+    {
+        RunLockstep<16>(chip, sweeps, instructionBudget, argv[argc - 1]);
+        return 0;
+    }
+
+    if (translatePath)
+    {
+        outf.open(translatePath);
+        if (!Translator::Translate(chip, outf, argv[argc - 1], instructionBudget))
+        {
+            std::cout << translatePath << " could not be written!";
+            return -1;
+        }
+
+        if (chip.ip_register < chip.m_programSize)
+        {
+            std::cout << argv[argc - 1] << " stopped at the -limit budget, " << translatePath << " has no expected state to check against.\n";
+        }
+
+        return 0;
+    }
+
+    DecodeCache decodeCache{};
+    decodeCache.Reset(chip.m_programSize);
+
+    switch (executionType)
     {
     case ExecutionType::print:
         std::cout << argv[argc - 1] << " disassembly:\nbits 16\n";
         break;
 
     case ExecutionType::outFile:
-        outf.open(argv[argc - 1]);
+        outf.open(outFilePath);
         outf << "bits 16\n";
         break;
 
     default:
-        if (Decoder::executionType == ExecutionType::dump)
+        // -run reports nothing but the final state.
+        if (!bRun)
         {
-            int32_t i = 0;
-            std::string filePath = std::format("sim8086_memory_{}.data", i);
-            while (std::filesystem::is_regular_file(filePath))
-            {
-                ++i;
-                filePath = "sim8086_memory_" + std::to_string(i) + ".data";
-            }
+            std::cout << argv[argc - 1] << " execution \n";
+        }
+        break;
+    }
 
-            outf.open(filePath, std::ios::binary);
+    TextSpace::TraceWriter trace{};
+    std::vector<std::string> disassembly(executionType >= ExecutionType::simulate ? chip.m_programSize : 0);
+
+    const TraceBin::TraceMode traceMode = executionType == ExecutionType::explainClocks ? TraceBin::TraceMode::explainClocks :
+        executionType == ExecutionType::showClocks ? TraceBin::TraceMode::showClocks : TraceBin::TraceMode::exec;
+
+    // -trace-bin writes records instead of trace lines, sim8086_traceview turns them back into text.
+    TraceBin::TraceFileWriter traceFile{};
+    if (bTraceBin && !traceFile.Open(traceBinPath, argv[argc - 1], traceMode, bBusModel, chip.m_program, static_cast<uint32_t>(chip.m_programSize)))
+    {
+        std::cout << traceBinPath << " could not be opened for writing!";
+        return -1;
+    }
+
+    // Dumps are written in the background while the simulation carries on.
+    std::unique_ptr<MemoryDumper> dumper{};
+    if (executionType == ExecutionType::dump)
+    {
+        dumper = std::make_unique<MemoryDumper>(dumpFormat);
+    }
+
+    // -repeat runs the program again from the same start, the final state reported is the last run's.
+    ChipSnapshot snapshot{};
+    if (repeatCount > 1)
+    {
+        snapshot.Capture(chip);
+    }
+
+    // Over every -repeat run, which -limit stops each of at.
+    uint64_t instructionsExecuted = 0;
+    // Whether a run ended on the budget with ip still in the program, rather than by running off its end.
+    bool bStoppedAtLimit = false;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (uint64_t run{ 0 }; bThreaded && run < repeatCount; ++run)
+    {
+        if (run > 0)
+        {
+            snapshot.Restore(chip);
         }
 
-        std::cout << argv[argc - 1] << " execution \n";
-        break;
+        // Threaded execution prints nothing per instruction and leaves ip past the program, so only the final state is reported.
+        // Blocks note their destinations as mutated when compiled, so every run compiles its own.
+        Jit jit{};
+
+        BlockEngine blockEngine(chip);
+        blockEngine.jit = bJit ? &jit : nullptr;
+
+        // Periodic dumps and the budget both happen at the first block boundary after that many instructions.
+        const bool bDumpEvery = dumper && dumpEvery > 0;
+        blockEngine.instructionLimit = bDumpEvery ? std::min(dumpEvery, instructionBudget) : instructionBudget;
+        blockEngine.Run();
+
+        while (bDumpEvery && chip.ip_register < chip.m_programSize && blockEngine.instructionsExecuted < instructionBudget)
+        {
+            dumper->Submit(chip);
+
+            blockEngine.instructionLimit = std::min(blockEngine.instructionsExecuted + dumpEvery, instructionBudget);
+            blockEngine.Run();
+        }
+
+        instructionsExecuted += blockEngine.instructionsExecuted;
+        bStoppedAtLimit = bStoppedAtLimit || chip.ip_register < chip.m_programSize;
+    }
+
+    // -profile counts instead of tracing, the report follows the final registers.
+    std::unique_ptr<Profiler> profiler{};
+    if (bProfile)
+    {
+        profiler = std::make_unique<Profiler>(chip);
     }
 
-    uint32_t* startPtr = &binaryInstructionStream[0];
-    virtualChip.ip_register = startPtr;
+    BusInterfaceUnit busInterfaceUnit(chip);
+    busInterfaceUnit.Reset(chip.ip_register);
 
-    while ((virtualChip.ip_register - startPtr) < bufferSize)
-    {;
-        uint32_t* oldIp = virtualChip.ip_register;
+    // Only a trace line or a -trace-bin record shows the flags, -run and the profiler don't write either.
+    const bool bRecordFlags = bTraceBin || (!profiler && !bRun);
+
+    std::unique_ptr<TimeTravel> timeTravel{};
+    if (!seekPositions.empty())
+    {
+        timeTravel = std::make_unique<TimeTravel>(chip);
+        timeTravel->bCountClocks = executionType >= ExecutionType::showClocks;
+    }
+
+    while (chip.ip_register < chip.m_programSize && instructionsExecuted < instructionBudget)
+    {
+        const uint32_t oldIp = chip.ip_register;
 
+        // Simulation keeps coming back to the same addresses, disassembly visits each one once.
         DecodedInstruction decodedInst;
-        Decoder::Disasm(decodedInst);
+        if (executionType >= ExecutionType::simulate)
+        {
+            decodedInst = decodeCache.Fetch(chip);
+        }
+        else
+        {
+            Decoder::Disasm(chip, chip.ip_register, decodedInst);
+        }
 
         // Output according to execution type.
-        switch (Decoder::executionType)
+        switch (executionType)
         {
         case ExecutionType::print:
             std::cout << decodedInst << '\n';
+            chip.ip_register += decodedInst.extraBits + 1;
             break;
 
         case ExecutionType::outFile:
             outf << decodedInst << '\n';
+            chip.ip_register += decodedInst.extraBits + 1;
             break;
 
         default:
-
-            std::bitset<16> oldFlags{ virtualChip.m_flags };
-            std::cout << decodedInst << " ; ";
-
-            if (Decoder::executionType >= ExecutionType::showClocks)
+        {
+            if (timeTravel)
             {
-                int32_t estimatedClocks = 0;
-                int32_t ea = 0;
-                Estimator::EstimateClocks(decodedInst, estimatedClocks, ea);
+                timeTravel->Record(decodedInst);
+            }
 
-                const int32_t sumClocks = estimatedClocks + ea;
-                virtualChip.totalClocks += sumClocks;
+            TraceBin::TraceRecord record{};
+            Simulator::ExecuteRecorded(chip, decodedInst, record, executionType >= ExecutionType::showClocks, bRecordFlags);
 
-                std::cout << " Clocks: +" << std::to_string(sumClocks) << " = " << std::to_string(virtualChip.totalClocks) <<
-                    (ea > 0 && Decoder::executionType == ExecutionType::explainClocks ?
-                        std::format(" ({} + {}ea)", estimatedClocks, ea) : "") << " | ";
+            if (bBusModel && executionType >= ExecutionType::showClocks)
+            {
+                const int32_t bookClocks = record.clocks + record.eaClocks + record.penaltyClocks;
+                record.busClocks = static_cast<uint16_t>(busInterfaceUnit.Execute(decodedInst, oldIp, chip.ip_register, bookClocks));
             }
 
-            if (decodedInst.DestOT != OperandType::ot_register || (decodedInst.opCode >= OpCode::op_je && decodedInst.opCode <= OpCode::op_jcxz))
+            ++instructionsExecuted;
+            if (dumper && dumpEvery > 0 && instructionsExecuted % dumpEvery == 0)
             {
-                Simulator::ExecuteInstruction(decodedInst);
-                std::cout << "ip:";
+                dumper->Submit(chip);
             }
-            else
-            {
-                const size_t RegisterIndex = Decoder::FindWordIndex(decodedInst.Dest, decodedInst.bWord);
-
-                std::cout << Decoder::reg_rm_word[RegisterIndex];
-                std::cout << ':';
-                TextSpace::PrintHex(4, virtualChip[RegisterIndex]);
-                std::cout << "->";
 
-                Simulator::ExecuteInstruction(decodedInst);
-                TextSpace::PrintHex(4, virtualChip[RegisterIndex]);
-                std::cout << " ip:";
+            if (bTraceBin)
+            {
+                traceFile.Append(record);
+                break;
             }
 
-            // print ip register's old and new distance to starting pointer.
-
-            TextSpace::PrintHex(2, std::distance(startPtr, oldIp));
-            std::cout << "->";
-            TextSpace::PrintHex(2, std::distance(startPtr, virtualChip.ip_register));
-
-            if (decodedInst.bPrintFlags)
+            if (profiler)
             {
-                std::cout << " flags:";
-
-                std::string oldFlagsStr{};
-                std::string newFlagsStr{};
-
-
-                for (size_t i{ 0 }; i < 16; ++i)
-                {
-                    if (oldFlags[i])
-                    {
-                        oldFlagsStr += virtualChip.m_flagSymbols[i];
-                    }
-
-                    if (virtualChip.m_flags[i])
-                    {
-                        newFlagsStr += virtualChip.m_flagSymbols[i];
-                    }
-                }
-
-                std::cout << oldFlagsStr << "->" << newFlagsStr;
+                profiler->Count(decodedInst, oldIp, record.clocks + record.eaClocks + record.penaltyClocks, record.eaClocks);
+                break;
             }
 
-            std::cout << '\n';
+            if (bRun)
+            {
+                break;
+            }
 
-            break;             
+            const TraceBin::TraceTotals totals{ chip.totalClocks, busInterfaceUnit.totalClocks };
+            TextSpace::WriteTraceLine(trace, TextSpace::InstructionText(disassembly, oldIp, decodedInst), record, totals, traceMode, bBusModel);
+            break;
+        }
         }
     }
 
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    bStoppedAtLimit = bStoppedAtLimit || chip.ip_register < chip.m_programSize;
+
     // final version of registers and flags.
-    if (Decoder::executionType == ExecutionType::dump)
+    if (dumper)
     {
-        outf.write(reinterpret_cast<const char*>(virtualChip.m_memory.data()), virtualChip.m_memory.size());
+        dumper->Submit(chip);
     }
-    if (Decoder::executionType >= ExecutionType::simulate)
+    if (executionType >= ExecutionType::simulate)
     {
-        std::cout << "\nFinal registers:\n";
+        const TraceBin::TraceFooter finalState = TextSpace::CurrentState(chip);
 
-        for (size_t i : virtualChip.m_mutatedRegisters)
+        if (bTraceBin && !traceFile.Close(finalState))
         {
-            const int32_t Val = static_cast<int32_t>(virtualChip[i]);
+            std::cout << traceBinPath << " could not be written!\n";
+        }
 
-            if (Val == 0)
-            {
-                continue;
-            }
+        TextSpace::WriteFinalRegisters(trace, finalState);
 
-            std::cout << "      " << Decoder::reg_rm_word[i] << ": ";
-            TextSpace::PrintHex(4, virtualChip[i]);
-            std::cout << " (" << static_cast<int32_t>(virtualChip[i]) << ")\n";
+        for (uint64_t position : seekPositions)
+        {
+            const bool bReached = timeTravel->Seek(position);
+            const std::string heading = bReached ? "Registers at instruction " + std::to_string(position) :
+                "Registers at the end, instruction " + std::to_string(timeTravel->Position());
+
+            TextSpace::WriteFinalRegisters(trace, TextSpace::CurrentState(chip), heading);
         }
 
-        int32_t distance = static_cast<int32_t>(std::distance(startPtr, virtualChip.ip_register));
+        trace.Flush();
 
-        std::cout << "      ip:";
-        TextSpace::PrintHex(4, distance);
-        std::cout << " (" << distance << ")";
+        if (bRun)
+        {
+            std::cout << "\nInstructions: " << instructionsExecuted <<
+                (bStoppedAtLimit ? " (stopped at the -limit budget)" : "") <<
+                "\nClocks: " << chip.totalClocks << (repeatCount > 1 ? " (last run)" : "") <<
+                "\nWall time: " << std::fixed << std::setprecision(6) << wallSeconds << " s" <<
+                "\nGuest MIPS: " << std::setprecision(2) << (wallSeconds > 0.0 ? static_cast<double>(instructionsExecuted) / wallSeconds / 1e6 : 0.0) << '\n';
+        }
 
-        if (virtualChip.m_flags.count() > 0)
+        if (profiler)
         {
-            std::cout << "\n  flags :";
-            for (size_t i{ 0 }; i < 16; ++i)
+            profiler->WriteReport(std::cout, 20);
+
+            if (profileCsvPath)
             {
-                if (virtualChip.m_flags[i])
-                {
-                    std::cout << virtualChip.m_flagSymbols[i];
-                }
+                std::ofstream csvFile(profileCsvPath);
+                profiler->WriteCsv(csvFile);
+            }
+
+            if (profileFoldedPath)
+            {
+                std::ofstream foldedFile(profileFoldedPath);
+                profiler->WriteFolded(foldedFile, argv[argc - 1]);
             }
         }
 
-        std::cout << '\n';
+        if (bPrintCacheStats)
+        {
+            std::cout << "\nDecode cache: " << decodeCache.hits << " hits, " << decodeCache.misses << " misses\n";
+        }
     }
 
     return 0;
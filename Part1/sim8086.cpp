@@ -1,113 +1,54 @@
 #include <string>
 #include <cassert>
-#include <iostream>
 
 #include "sim8086.h"
 #include "sim8086_decoder.h"
-#include "sim8086_text.h"
+#include "sim8086_estimation.h"
+#include "sim8086_tracebin.h"
 
-static void SetFlags(DecodedInstruction& decodedInst, uint16_t NewVal, uint16_t OldDestVal, uint16_t SourceVal)
+const std::bitset<16>& Simulator::GetFlags(VirtualChip& chip)
 {
-	decodedInst.bPrintFlags = true;
-
-	// CF Flag
-	if (decodedInst.opCode == OpCode::op_add ? OldDestVal > NewVal : OldDestVal < NewVal)
-	{
-		virtualChip.m_flags[0] = 1;
-	}
-	else
-	{
-		virtualChip.m_flags[0] = 0;
-	}
-
-	// PF Flag	
-	if (std::bitset<8> (static_cast<uint8_t>(NewVal)).count() % 2 == 0)
-	{
-		virtualChip.m_flags[2] = 1;
-	}
-	else
-	{
-		virtualChip.m_flags[2] = 0;
-	}
-
-	// AF Flag
-	if ((OldDestVal ^ SourceVal ^ NewVal) & 0x10)
-	{
-		virtualChip.m_flags[4] = 1;
-	}
-	else
+	if (chip.m_lazyFlags.opCode != OpCode::op_undefined)
 	{
-		virtualChip.m_flags[4] = 0;
-	}
+		for (size_t bit : { 0, 2, 4, 6, 7, 11 })
+		{
+			chip.m_flags[bit] = ComputeFlag(chip, chip.m_lazyFlags, bit);
+		}
 
-	// SF Flag
-	if (NewVal & 0x8000)
-	{
-		virtualChip.m_flags[7] = 1;
-	}
-	else 
-	{
-		virtualChip.m_flags[7] = 0;
+		chip.m_lazyFlags.opCode = OpCode::op_undefined;
 	}
 
-	// ZF Flag
-	if (NewVal == 0)
-	{
-		virtualChip.m_flags[6] = 1;
-	}
-	else
-	{
-		virtualChip.m_flags[6] = 0;
-	}
-
-	// OF Flag
-	if (((decodedInst.opCode == OpCode::op_add ?
-		~(OldDestVal ^ SourceVal) : (OldDestVal ^ SourceVal)) &
-		(OldDestVal ^ NewVal)) & 0x8000)
-	{
-		virtualChip.m_flags[11] = 1;
-	}
-	else
-	{
-		virtualChip.m_flags[11] = 0;
-	}
+	return chip.m_flags;
 }
 
-static size_t FillRegisterAddress(const std::string& regStr, uint16_t*& wordPtr, uint8_t*& bytePtr, bool bWord)
+static size_t FillRegisterAddress(VirtualChip& chip, const RegisterAccess& reg, uint16_t*& wordPtr, uint8_t*& bytePtr, bool bWord)
 {
-	const size_t index = Decoder::FindWordIndex(regStr, bWord);
+	const size_t index = static_cast<size_t>(reg.index);
 	if (bWord)
 	{
-		wordPtr = &virtualChip[index];
+		wordPtr = &chip[index];
 	}
 	else
 	{
-		if (index >= 0)
-		{
-			bytePtr = reinterpret_cast<uint8_t*>(&virtualChip[index]);
-			if (index % 2 != 0)
-			{
-				bytePtr += 1;
-			}
-		}
+		bytePtr = &chip.m_registers.Byte(reg);
 	}
 
 	return index;
 }
 
-static void FillMemoryAddress(uint16_t*& wordPtr, uint8_t*& bytePtr, size_t index, bool bWord)
+static void FillMemoryAddress(VirtualChip& chip, uint16_t*& wordPtr, uint8_t*& bytePtr, size_t index, bool bWord)
 {
 	if (bWord)
 	{
-		wordPtr = reinterpret_cast<uint16_t*>(&virtualChip.m_memory[index]);
+		wordPtr = reinterpret_cast<uint16_t*>(&chip.m_memory[index]);
 	}
 	else
 	{
-		bytePtr = &virtualChip.m_memory[index];
+		bytePtr = &chip.m_memory[index];
 	}
 }
 
-void Simulator::ExecuteInstruction(DecodedInstruction& decodedInst)
+bool Simulator::ExecuteInstruction(VirtualChip& chip, DecodedInstruction& decodedInst)
 {
 	uint16_t* destWord = nullptr;
 	uint16_t* sourceWord = nullptr;
@@ -120,39 +61,42 @@ void Simulator::ExecuteInstruction(DecodedInstruction& decodedInst)
 
 	const bool bWord = decodedInst.bWord;
 
-	virtualChip.ip_register += decodedInst.extraBits + 1;
+	chip.ip_register += decodedInst.extraBits + 1;
 
-	if (decodedInst.DestOT != OperandType::ot_jumpTarget)
+	if (decodedInst.DestOT != OperandType::ot_jumpTarget && decodedInst.opCode != OpCode::op_undefined)
 	{
 		if (decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator)
 		{
-			virtualChip.AddUniqueMutatedRegister(FillRegisterAddress(decodedInst.Dest, destWord, destByte, bWord));
+			chip.AddUniqueMutatedRegister(FillRegisterAddress(chip, decodedInst.Dest.reg, destWord, destByte, bWord));
 		}
 		else if (decodedInst.DestOT == OperandType::ot_memory)
 		{
-			FillMemoryAddress(destWord, destByte, decodedInst.memoryIndex, bWord);
+			decodedInst.memoryIndex = Decoder::GetEffectiveAddressIndex(chip, decodedInst.Dest.address);
+			FillMemoryAddress(chip, destWord, destByte, decodedInst.memoryIndex, bWord);
+			chip.MarkDirty(decodedInst.memoryIndex, bWord ? 2 : 1);
 		}
 
 		if (decodedInst.SourceOT == OperandType::ot_register || decodedInst.SourceOT == OperandType::ot_accumulator)
 		{
-			FillRegisterAddress(decodedInst.Source, sourceWord, sourceByte,bWord);
+			FillRegisterAddress(chip, decodedInst.Source.reg, sourceWord, sourceByte, bWord);
 		}
 		else if (decodedInst.SourceOT == OperandType::ot_immediate)
 		{
 			if (bWord)
 			{
-				immediateWord = static_cast<uint16_t>(std::stoi(decodedInst.Source));
+				immediateWord = static_cast<uint16_t>(decodedInst.Source.immediate);
 				sourceWord = &immediateWord;
 			}
 			else
 			{
-				immediateByte = static_cast<uint8_t>(std::stoi(decodedInst.Source));
+				immediateByte = static_cast<uint8_t>(decodedInst.Source.immediate);
 				sourceByte = &immediateByte;
 			}
 		}
 		else if (decodedInst.SourceOT == OperandType::ot_memory)
 		{
-			FillMemoryAddress(sourceWord, sourceByte, decodedInst.memoryIndex, bWord);
+			decodedInst.memoryIndex = Decoder::GetEffectiveAddressIndex(chip, decodedInst.Source.address);
+			FillMemoryAddress(chip, sourceWord, sourceByte, decodedInst.memoryIndex, bWord);
 		}
 
 		if (destWord)
@@ -173,206 +117,136 @@ void Simulator::ExecuteInstruction(DecodedInstruction& decodedInst)
 	switch (decodedInst.opCode)
 	{
 	case OpCode::op_mov:
-		
 		if (bWord)
 		{
 			assert(destWord && sourceWord);
-			*destWord = *sourceWord;			
+			Arithmetic<OpCode::op_mov>(chip, *destWord, *sourceWord);
 		}
 		else
 		{
 			assert(destByte && sourceByte);
-			*destByte = *sourceByte;
+			Arithmetic<OpCode::op_mov>(chip, *destByte, *sourceByte);
 		}
 
 		break;
 
 	case OpCode::op_add:
+		decodedInst.bPrintFlags = true;
 
 		if (bWord)
 		{
 			assert(destWord && sourceWord);
-			*destWord += *sourceWord;
-			SetFlags(decodedInst, *destWord, OldDestVal, *sourceWord);
+			Arithmetic<OpCode::op_add>(chip, *destWord, *sourceWord);
 		}
 		else
 		{
 			assert(destByte && sourceByte);
-			*destByte += *sourceByte;
-			SetFlags(decodedInst, static_cast<uint16_t>(*destByte), OldDestVal, static_cast<uint16_t>(*sourceByte));
+			Arithmetic<OpCode::op_add>(chip, *destByte, *sourceByte);
 		}
 
 		break;
 
 	case OpCode::op_sub:
+		decodedInst.bPrintFlags = true;
 
 		if (bWord)
 		{
 			assert(destWord && sourceWord);
-			*destWord -= *sourceWord;
-			SetFlags(decodedInst, *destWord, OldDestVal, *sourceWord);
+			Arithmetic<OpCode::op_sub>(chip, *destWord, *sourceWord);
 		}
 		else
 		{
 			assert(destByte && sourceByte);
-			*destByte -= *sourceByte;
-			SetFlags(decodedInst, static_cast<uint16_t>(*destByte), OldDestVal, static_cast<uint16_t>(*sourceByte));
+			Arithmetic<OpCode::op_sub>(chip, *destByte, *sourceByte);
 		}
 
 		break;
 
 	case OpCode::op_cmp:
+		decodedInst.bPrintFlags = true;
 
 		if (bWord)
 		{
 			assert(destWord && sourceWord);
-			SetFlags(decodedInst, *destWord - *sourceWord, OldDestVal, *sourceWord);
+			Arithmetic<OpCode::op_cmp>(chip, *destWord, *sourceWord);
 		}
 		else
 		{
 			assert(destByte && sourceByte);
-			*destByte -= *sourceByte;
-			SetFlags(decodedInst, static_cast<uint16_t>(*destByte - *sourceByte), OldDestVal, static_cast<uint16_t>(*sourceByte));
+			Arithmetic<OpCode::op_cmp>(chip, *destByte, *sourceByte);
 		}
 
 		break;
-	
-	case OpCode::op_je:
-		if (virtualChip.m_flags[6])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jl:
-		if (virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jle:
-		if (virtualChip.m_flags[6] || virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jb:
-		if (virtualChip.m_flags[1])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jbe:
-		if (virtualChip.m_flags[1] || virtualChip.m_flags[6])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jp:
-		if (virtualChip.m_flags[2])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jo:
-		if (!virtualChip.m_flags[11])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case  OpCode::op_js:
-		if (virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jne:
-		if (!virtualChip.m_flags[6])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jnl:
-		if (!virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jnle:
-		if (!virtualChip.m_flags[6] && virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jnb:
-		if (!virtualChip.m_flags[1])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jnbe:
-		if (!virtualChip.m_flags[1] && !virtualChip.m_flags[6])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jnp:
-		if (!virtualChip.m_flags[2])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jno:
-		if (!virtualChip.m_flags[11])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_jns:
-		if (virtualChip.m_flags[7])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
-	case OpCode::op_loop:
-		if (virtualChip[1])
-		{
-			--virtualChip[1];
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
 
-	case OpCode::op_loopz:
-		--virtualChip[1];
-		if (virtualChip[1])
+	default:
+		if (decodedInst.DestOT == OperandType::ot_jumpTarget && BranchTaken(chip, decodedInst.opCode))
 		{
-			virtualChip.ip_register += decodedInst.destTarget;
+			chip.ip_register += decodedInst.destTarget;
+			return true;
 		}
+
 		break;
+	}
 
-	case OpCode::op_loopnz:
+	return false;
+}
 
-		std::cout << "cx: ";
-		TextSpace::PrintHex<uint16_t>(4, virtualChip[1]);
-		std::cout << "->";
-		--virtualChip[1];
-		TextSpace::PrintHex<uint16_t>(4, virtualChip[1]);
-		std::cout << " ";
+void Simulator::ExecuteRecorded(VirtualChip& chip, DecodedInstruction& decodedInst, TraceBin::TraceRecord& record, bool bCountClocks, bool bRecordFlags)
+{
+	record.ip = chip.ip_register;
+	record.opCode = static_cast<uint8_t>(decodedInst.opCode);
+	if (bRecordFlags)
+	{
+		record.oldFlags = static_cast<uint16_t>(GetFlags(chip).to_ulong());
+	}
 
-		if (!virtualChip.m_flags[6] && virtualChip[1])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
+	// Register the line reports the old and new value of. Undefined opcodes keep the default register operand, reg_none.
+	record.reg = TraceBin::noRegister;
+	if (decodedInst.opCode == OpCode::op_loopnz)
+	{
+		record.reg = 1;
+	}
+	else if (decodedInst.opCode != OpCode::op_undefined && decodedInst.DestOT == OperandType::ot_register &&
+		decodedInst.Dest.reg.index != Register::reg_none && !(decodedInst.opCode >= OpCode::op_je && decodedInst.opCode <= OpCode::op_jcxz))
+	{
+		record.reg = static_cast<uint8_t>(decodedInst.Dest.reg.index);
+	}
 
-		break;
+	if (record.reg != TraceBin::noRegister)
+	{
+		record.oldValue = chip[static_cast<size_t>(record.reg)];
+	}
 
-	case OpCode::op_jcxz:
-		if (!virtualChip[1])
-		{
-			virtualChip.ip_register += decodedInst.destTarget;
-		}
-		break;
+	const bool bBranchTaken = ExecuteInstruction(chip, decodedInst);
 
-	default:
-		break;
+	// Clocks depend on whether a branch was taken and on the address the instruction ended up using.
+	if (bCountClocks)
+	{
+		int32_t estimatedClocks = 0;
+		int32_t ea = 0;
+		Estimator::EstimateClocks(decodedInst, estimatedClocks, ea, bBranchTaken);
+
+		const int32_t penalty = Estimator::TransferPenalty(chip, decodedInst);
+		chip.totalClocks += estimatedClocks + ea + penalty;
+
+		record.clocks = static_cast<uint8_t>(estimatedClocks);
+		record.eaClocks = static_cast<uint8_t>(ea);
+		record.penaltyClocks = static_cast<uint8_t>(penalty);
 	}
+
+	if (record.reg != TraceBin::noRegister)
+	{
+		record.newValue = chip[static_cast<size_t>(record.reg)];
+	}
+
+	record.nextIp = chip.ip_register;
+	if (bRecordFlags)
+	{
+		record.newFlags = decodedInst.bPrintFlags ? static_cast<uint16_t>(GetFlags(chip).to_ulong()) : record.oldFlags;
+	}
+}
+
+bool Simulator::BranchTaken(VirtualChip& chip, OpCode opCode)
+{
+	return BranchTaken(chip, opCode, [&chip](size_t bit) { return GetFlag(chip, bit); });
 }
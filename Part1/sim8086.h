@@ -1,8 +1,173 @@
 #pragma once
 
-struct DecodedInstruction;
+#include <bit>
+#include <cstdint>
+
+#include "sim8086_decoder.h"
+
+namespace TraceBin
+{
+	struct TraceRecord;
+}
 
 namespace Simulator
 {
-	void ExecuteInstruction(DecodedInstruction& decodedInst);
-}
\ No newline at end of file
+	// Returns whether the instruction was a jump, loop or jcxz that was taken, which the clocks depend on.
+	bool ExecuteInstruction(VirtualChip& chip, DecodedInstruction& decodedInst);
+
+	// ExecuteInstruction for the stepping simulator, filling record with what a trace line or -trace-bin record shows.
+	// bCountClocks estimates the clocks and adds them to chip.totalClocks, the flags are read only with bRecordFlags.
+	void ExecuteRecorded(VirtualChip& chip, DecodedInstruction& decodedInst, TraceBin::TraceRecord& record, bool bCountClocks, bool bRecordFlags);
+
+	// Only records the operation, its flags are worked out when something reads them.
+	inline void SetFlags(VirtualChip& chip, OpCode opCode, uint16_t NewVal, uint16_t OldDestVal, uint16_t SourceVal)
+	{
+		chip.m_lazyFlags = { opCode, NewVal, OldDestVal, SourceVal };
+	}
+
+	// Flag at bit as the operation recorded in lazy leaves it. Bits it doesn't touch come from m_flags.
+	inline bool ComputeFlag(const VirtualChip& chip, const LazyFlags& lazy, size_t bit)
+	{
+		switch (bit)
+		{
+		// CF Flag
+		case 0:
+			return lazy.opCode == OpCode::op_add ? lazy.oldDestVal > lazy.newVal : lazy.oldDestVal < lazy.newVal;
+
+		// PF Flag
+		case 2:
+			return std::popcount(static_cast<uint8_t>(lazy.newVal)) % 2 == 0;
+
+		// AF Flag
+		case 4:
+			return (lazy.oldDestVal ^ lazy.sourceVal ^ lazy.newVal) & 0x10;
+
+		// ZF Flag
+		case 6:
+			return lazy.newVal == 0;
+
+		// SF Flag
+		case 7:
+			return lazy.newVal & 0x8000;
+
+		// OF Flag
+		case 11:
+			return ((lazy.opCode == OpCode::op_add ?
+				~(lazy.oldDestVal ^ lazy.sourceVal) : (lazy.oldDestVal ^ lazy.sourceVal)) &
+				(lazy.oldDestVal ^ lazy.newVal)) & 0x8000;
+
+		default:
+			return chip.m_flags[bit];
+		}
+	}
+
+	// A single flag by bit position, without materializing the others.
+	inline bool GetFlag(const VirtualChip& chip, size_t bit)
+	{
+		if (chip.m_lazyFlags.opCode == OpCode::op_undefined)
+		{
+			return chip.m_flags[bit];
+		}
+
+		return ComputeFlag(chip, chip.m_lazyFlags, bit);
+	}
+
+	// All flags, writes the pending arithmetic flags to m_flags first.
+	const std::bitset<16>& GetFlags(VirtualChip& chip);
+
+	// Whether a jump, loop or jcxz goes to its target. Loops update cx on the way.
+	bool BranchTaken(VirtualChip& chip, OpCode opCode);
+
+	// BranchTaken reading the flags through getFlag(bit), for callers that know where they come from.
+	template <typename FlagReader>
+	inline bool BranchTaken(VirtualChip& chip, OpCode opCode, FlagReader getFlag)
+	{
+		switch (opCode)
+		{
+		case OpCode::op_je:
+			return getFlag(6);
+		case OpCode::op_jl:
+			return getFlag(7);
+		case OpCode::op_jle:
+			return getFlag(6) || getFlag(7);
+		case OpCode::op_jb:
+			return getFlag(1);
+		case OpCode::op_jbe:
+			return getFlag(1) || getFlag(6);
+		case OpCode::op_jp:
+			return getFlag(2);
+		case OpCode::op_jo:
+			return !getFlag(11);
+		case OpCode::op_js:
+			return getFlag(7);
+		case OpCode::op_jne:
+			return !getFlag(6);
+		case OpCode::op_jnl:
+			return !getFlag(7);
+		case OpCode::op_jnle:
+			return !getFlag(6) && getFlag(7);
+		case OpCode::op_jnb:
+			return !getFlag(1);
+		case OpCode::op_jnbe:
+			return !getFlag(1) && !getFlag(6);
+		case OpCode::op_jnp:
+			return !getFlag(2);
+		case OpCode::op_jno:
+			return !getFlag(11);
+		case OpCode::op_jns:
+			return getFlag(7);
+		case OpCode::op_loop:
+			if (chip[1])
+			{
+				--chip[1];
+				return true;
+			}
+			return false;
+
+		case OpCode::op_loopz:
+			--chip[1];
+			return chip[1];
+
+		case OpCode::op_loopnz:
+			--chip[1];
+			return !getFlag(6) && chip[1];
+
+		case OpCode::op_jcxz:
+			return !chip[1];
+
+		default:
+			return false;
+		}
+	}
+
+	// mov, add, sub or cmp on an already resolved byte or word destination.
+	template <OpCode opCode, typename T>
+	inline void Arithmetic(VirtualChip& chip, T& dest, T source)
+	{
+		const uint16_t OldDestVal = dest;
+
+		if constexpr (opCode == OpCode::op_mov)
+		{
+			dest = source;
+		}
+		else if constexpr (opCode == OpCode::op_add)
+		{
+			dest += source;
+			SetFlags(chip, opCode, dest, OldDestVal, source);
+		}
+		else if constexpr (opCode == OpCode::op_sub)
+		{
+			dest -= source;
+			SetFlags(chip, opCode, dest, OldDestVal, source);
+		}
+		else if constexpr (opCode == OpCode::op_cmp)
+		{
+			if constexpr (sizeof(T) == 1)
+			{
+				dest -= source;
+			}
+
+			SetFlags(chip, opCode, static_cast<uint16_t>(dest - source), OldDestVal, source);
+		}
+	}
+}
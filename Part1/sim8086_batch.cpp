@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+
+#include "sim8086_batch.h"
+#include "sim8086_blocks.h"
+#include "sim8086_decoder.h"
+#include "sim8086_jit.h"
+#include "sim8086_loader.h"
+#include "sim8086_text.h"
+
+BatchRunner::BatchRunner(size_t threadCount)
+	: m_threadCount(std::max<size_t>(threadCount, 1))
+{
+}
+
+std::vector<std::string> BatchRunner::ListPrograms(const std::string& path)
+{
+	std::vector<std::string> programs{};
+	std::error_code error{};
+
+	if (std::filesystem::is_directory(path, error))
+	{
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(path, error))
+		{
+			if (entry.is_regular_file(error))
+			{
+				programs.push_back(entry.path().string());
+			}
+		}
+
+		std::sort(programs.begin(), programs.end());
+		return programs;
+	}
+
+	std::ifstream list(path);
+	for (std::string line{}; std::getline(list, line); )
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		if (!line.empty())
+		{
+			programs.push_back(line);
+		}
+	}
+
+	return programs;
+}
+
+std::vector<BatchResult> BatchRunner::Run(const std::vector<std::string>& programs, const std::string& outputDirectory)
+{
+	std::error_code error{};
+	std::filesystem::create_directories(outputDirectory, error);
+
+	m_programs = &programs;
+	m_results.assign(programs.size(), BatchResult{});
+	m_outputPaths.clear();
+
+	// Programs of the same name in different directories get the position in the batch added to theirs, counting
+	// on from there if a program is already called that.
+	std::set<std::string> names{};
+	for (size_t job{ 0 }; job < programs.size(); ++job)
+	{
+		const std::string fileName = std::filesystem::path(programs[job]).filename().string();
+
+		std::string name = fileName;
+		for (size_t suffix{ job }; !names.insert(name).second; ++suffix)
+		{
+			name = fileName + '_' + std::to_string(suffix);
+		}
+
+		m_outputPaths.push_back((std::filesystem::path(outputDirectory) / (name + ".txt")).string());
+	}
+
+	const size_t threadCount = std::min(m_threadCount, std::max<size_t>(programs.size(), 1));
+	m_queues = std::vector<WorkQueue>(threadCount);
+	for (size_t job{ 0 }; job < programs.size(); ++job)
+	{
+		m_queues[job % threadCount].jobs.push_back(job);
+	}
+
+	std::vector<std::thread> workers{};
+	for (size_t worker{ 1 }; worker < threadCount; ++worker)
+	{
+		workers.emplace_back(&BatchRunner::Work, this, worker);
+	}
+
+	Work(0);
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	m_programs = nullptr;
+	return std::move(m_results);
+}
+
+bool BatchRunner::NextJob(size_t worker, size_t& job)
+{
+	{
+		WorkQueue& own = m_queues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+
+	// Nothing is queued once the run started, so every queue found empty stays empty.
+	for (size_t i{ 1 }; i < m_queues.size(); ++i)
+	{
+		WorkQueue& victim = m_queues[(worker + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void BatchRunner::Work(size_t worker)
+{
+	for (size_t job{}; NextJob(worker, job); )
+	{
+		m_results[job] = RunProgram((*m_programs)[job], m_outputPaths[job]);
+	}
+}
+
+BatchResult BatchRunner::RunProgram(const std::string& programPath, const std::string& outputPath) const
+{
+	BatchResult result{};
+
+	ProgramImage program{};
+	if (!program.Open(programPath.c_str()))
+	{
+		return result;
+	}
+
+	result.bLoaded = true;
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	VirtualChip chip{};
+	chip.m_program = program.Data();
+	chip.m_programSize = program.Size();
+	chip.cpuTarget = cpuTarget;
+
+	Jit jit{};
+
+	BlockEngine blockEngine(chip);
+	blockEngine.jit = bJit ? &jit : nullptr;
+	blockEngine.instructionLimit = instructionLimit;
+	blockEngine.Run();
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	result.instructions = blockEngine.instructionsExecuted;
+	result.clocks = chip.totalClocks;
+	result.finalState = TextSpace::CurrentState(chip);
+
+	std::ofstream out(outputPath);
+	{
+		TextSpace::TraceWriter trace(out);
+		trace.Write(programPath);
+		trace.Write(" execution \n");
+		TextSpace::WriteFinalRegisters(trace, result.finalState);
+
+		trace.Write("\nInstructions: ");
+		trace.Decimal(static_cast<int64_t>(result.instructions));
+		if (result.instructions >= instructionLimit)
+		{
+			trace.Write(" (stopped at the -limit budget)");
+		}
+
+		trace.Write("\nClocks: ");
+		trace.Decimal(result.clocks);
+		trace.Write('\n');
+	}
+
+	result.bWritten = static_cast<bool>(out);
+	return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sim8086_estimation.h"
+#include "sim8086_tracebin.h"
+
+// Result of one program of a -batch run.
+struct BatchResult
+{
+	bool bLoaded = false;
+	bool bWritten = false;
+	uint64_t instructions = 0;
+	int64_t clocks = 0;
+	double seconds = 0.0;
+	TraceBin::TraceFooter finalState{};
+};
+
+// Runs many programs at once for -batch, each in a VirtualChip of its own on the block engine. Programs are dealt out
+// to one queue per worker up front. A worker takes its own newest first and steals the oldest of another queue once
+// its own runs dry, so a few long programs don't leave the other threads idle.
+class BatchRunner
+{
+public:
+	explicit BatchRunner(size_t threadCount);
+
+	// Every regular file in directory path, sorted by name, or else every line of the list file at path.
+	static std::vector<std::string> ListPrograms(const std::string& path);
+
+	// Runs every program and writes its final registers, instructions and clocks to outputDirectory, one
+	// file each named after the program. Returns once all are done, results in the order of programs.
+	std::vector<BatchResult> Run(const std::vector<std::string>& programs, const std::string& outputDirectory);
+
+	bool bJit = false;
+	uint64_t instructionLimit = UINT64_MAX;
+	Estimator::CpuTarget cpuTarget = Estimator::CpuTarget::i8086;
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex{};
+		std::deque<size_t> jobs{};
+	};
+
+	bool NextJob(size_t worker, size_t& job);
+	void Work(size_t worker);
+	BatchResult RunProgram(const std::string& programPath, const std::string& outputPath) const;
+
+	size_t m_threadCount = 1;
+	std::vector<WorkQueue> m_queues{};
+
+	const std::vector<std::string>* m_programs = nullptr;
+	std::vector<std::string> m_outputPaths{};
+	std::vector<BatchResult> m_results{};
+};
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sim8086.h"
+#include "sim8086_blocks.h"
+#include "sim8086_decoder.h"
+#include "sim8086_jit.h"
+#include "sim8086_loader.h"
+#include "sim8086_snapshot.h"
+#include "sim8086_text.h"
+#include "sim8086_workload.h"
+
+// Throughput of decoding, executing and tracing on a synthetic program, best of several runs each, so
+// the numbers can be compared from one commit to the next. Same seed and mix, same program.
+//
+// usage: sim8086_bench [-seed N] [-instructions N] [-iterations N] [-runs N] [-mix key=value[,key=value...]] [-save FILE]
+//
+// -mix keys are mov, add, sub, cmp, test and branch for instructions, reg, imm, mem and direct for operands,
+// and byte for the percentage of byte operands. See WorkloadMix.
+
+// Swallows trace output while counting it, so the terminal doesn't become what is measured.
+class CountingBuffer : public std::streambuf
+{
+public:
+    uint64_t bytes = 0;
+
+protected:
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        bytes += static_cast<uint64_t>(count);
+        return count;
+    }
+
+    int_type overflow(int_type c) override
+    {
+        ++bytes;
+        return traits_type::not_eof(c);
+    }
+};
+
+struct Measurement
+{
+    double seconds = 0.0;
+    uint64_t instructions = 0;
+};
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Measurement Decode(const VirtualChip& chip, size_t passes)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    Measurement measurement{};
+    for (size_t pass{ 0 }; pass < passes; ++pass)
+    {
+        uint32_t ip = 0;
+        while (ip < chip.m_programSize)
+        {
+            DecodedInstruction decodedInst;
+            Decoder::Disasm(chip, ip, decodedInst);
+
+            ip += static_cast<uint32_t>(decodedInst.extraBits + 1);
+            ++measurement.instructions;
+        }
+    }
+
+    measurement.seconds = Seconds(start);
+    return measurement;
+}
+
+static Measurement Step(VirtualChip& chip)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    DecodeCache decodeCache{};
+    decodeCache.Reset(chip.m_programSize);
+
+    Measurement measurement{};
+    while (chip.ip_register < chip.m_programSize)
+    {
+        DecodedInstruction decodedInst = decodeCache.Fetch(chip);
+        Simulator::ExecuteInstruction(chip, decodedInst);
+        ++measurement.instructions;
+    }
+
+    measurement.seconds = Seconds(start);
+    return measurement;
+}
+
+static Measurement Blocks(VirtualChip& chip, bool bJit)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    Jit jit{};
+    BlockEngine blockEngine(chip);
+    blockEngine.jit = bJit ? &jit : nullptr;
+    blockEngine.Run();
+
+    return { Seconds(start), blockEngine.instructionsExecuted };
+}
+
+// What sim8086 -showclocks does per instruction, written to out.
+static Measurement Trace(VirtualChip& chip, TextSpace::TraceWriter& trace)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    DecodeCache decodeCache{};
+    decodeCache.Reset(chip.m_programSize);
+    std::vector<std::string> disassembly(chip.m_programSize);
+
+    Measurement measurement{};
+    while (chip.ip_register < chip.m_programSize)
+    {
+        const uint32_t oldIp = chip.ip_register;
+        DecodedInstruction decodedInst = decodeCache.Fetch(chip);
+
+        TraceBin::TraceRecord record{};
+        Simulator::ExecuteRecorded(chip, decodedInst, record, true, true);
+
+        const TraceBin::TraceTotals totals{ chip.totalClocks, 0 };
+        TextSpace::WriteTraceLine(trace, TextSpace::InstructionText(disassembly, oldIp, decodedInst), record, totals, TraceBin::TraceMode::showClocks);
+        ++measurement.instructions;
+    }
+
+    trace.Flush();
+
+    measurement.seconds = Seconds(start);
+    return measurement;
+}
+
+// Best of runs calls to measure, each from the state snapshot holds.
+template <typename Measure>
+static Measurement Best(VirtualChip& chip, ChipSnapshot& snapshot, uint32_t runs, Measure measure)
+{
+    Measurement best{};
+    for (uint32_t run{ 0 }; run < runs; ++run)
+    {
+        snapshot.Restore(chip);
+
+        const Measurement measurement = measure();
+        if (run == 0 || measurement.seconds < best.seconds)
+        {
+            best = measurement;
+        }
+    }
+
+    return best;
+}
+
+static void Report(const char* name, const Measurement& measurement)
+{
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2) <<
+        std::setw(10) << static_cast<double>(measurement.instructions) / measurement.seconds / 1e6 << " M instructions/s  (" <<
+        measurement.instructions << " in " << std::setprecision(4) << measurement.seconds << " s)\n";
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seed = 1;
+    uint32_t bodyInstructions = 4096;
+    uint32_t iterations = 2000;
+    uint32_t runs = 5;
+    const char* savePath = nullptr;
+    WorkloadMix mix{};
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg = std::string(argv[i]);
+        const bool bHasValue = i + 1 < argc;
+
+        if (arg == "-seed" && bHasValue)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "-instructions" && bHasValue)
+        {
+            bodyInstructions = std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0)), 1);
+        }
+        else if (arg == "-iterations" && bHasValue)
+        {
+            iterations = static_cast<uint32_t>(std::clamp<unsigned long>(std::strtoul(argv[++i], nullptr, 0), 1, UINT16_MAX));
+        }
+        else if (arg == "-runs" && bHasValue)
+        {
+            runs = std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0)), 1);
+        }
+        else if (arg == "-mix" && bHasValue)
+        {
+            std::istringstream weights(argv[++i]);
+            for (std::string weight{}; std::getline(weights, weight, ','); )
+            {
+                if (!mix.Set(weight))
+                {
+                    std::cout << "Unknown mix weight " << weight << '\n';
+                    return -1;
+                }
+            }
+        }
+        else if (arg == "-save" && bHasValue)
+        {
+            savePath = argv[++i];
+        }
+        else
+        {
+            std::cout << "usage: sim8086_bench [-seed N] [-instructions N] [-iterations N] [-runs N] [-mix key=value[,key=value...]] [-save FILE]\n";
+            return -1;
+        }
+    }
+
+    if (mix.mov + mix.add + mix.sub + mix.cmp + mix.test == 0 || mix.registers + mix.immediates + mix.memory + mix.direct == 0)
+    {
+        std::cout << "The mix needs at least one instruction other than branch and one operand form!\n";
+        return -1;
+    }
+
+    WorkloadGenerator generator(seed);
+    std::vector<uint8_t> program = generator.Generate(mix, bodyInstructions, static_cast<uint16_t>(iterations));
+
+    if (savePath)
+    {
+        std::ofstream saveFile(savePath, std::ios::binary);
+        saveFile.write(reinterpret_cast<const char*>(program.data()), static_cast<std::streamsize>(program.size()));
+    }
+
+    const size_t programSize = program.size();
+    program.resize(programSize + ProgramImage::padding);
+
+    VirtualChip chip{};
+    chip.m_program = program.data();
+    chip.m_programSize = programSize;
+
+    ChipSnapshot snapshot{};
+    snapshot.Capture(chip);
+
+    std::cout << "workload: seed " << seed << ", " << bodyInstructions << " instructions looping " << iterations <<
+        " times, " << programSize << " bytes\n";
+
+    // Enough passes over the program to take a while on its own.
+    const size_t decodePasses = std::max<size_t>((64u << 20) / programSize, 1);
+    const Measurement decode = Best(chip, snapshot, runs, [&chip, decodePasses] { return Decode(chip, decodePasses); });
+
+    std::cout << std::left << std::setw(10) << "decode" << std::right << std::fixed << std::setprecision(2) <<
+        std::setw(10) << static_cast<double>(programSize * decodePasses) / decode.seconds / 1e6 << " MB/s            (" <<
+        decode.instructions << " instructions in " << std::setprecision(4) << decode.seconds << " s)\n";
+
+    Report("step", Best(chip, snapshot, runs, [&chip] { return Step(chip); }));
+    Report("threaded", Best(chip, snapshot, runs, [&chip] { return Blocks(chip, false); }));
+    Report("jit", Best(chip, snapshot, runs, [&chip] { return Blocks(chip, true); }));
+
+    // Trace text goes nowhere, but is formatted in full.
+    CountingBuffer countingBuffer{};
+    std::streambuf* const coutBuffer = std::cout.rdbuf(&countingBuffer);
+
+    Measurement trace{};
+    {
+        TextSpace::TraceWriter traceWriter{};
+        trace = Best(chip, snapshot, runs, [&chip, &traceWriter] { return Trace(chip, traceWriter); });
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    Report("trace", trace);
+    std::cout << std::setw(20) << std::fixed << std::setprecision(2) <<
+        static_cast<double>(countingBuffer.bytes) / runs / trace.seconds / 1e6 << " MB/s of trace text\n";
+
+    return 0;
+}
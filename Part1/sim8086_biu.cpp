@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include "sim8086_biu.h"
+#include "sim8086_decoder.h"
+#include "sim8086_estimation.h"
+
+static constexpr int32_t busCycleClocks = 4;
+
+BusInterfaceUnit::BusInterfaceUnit(const VirtualChip& chip)
+	: m_chip(chip)
+{
+}
+
+void BusInterfaceUnit::Reset(uint32_t ip)
+{
+	totalClocks = 0;
+	m_busFreeAt = 0;
+	m_fetchIp = ip;
+	m_queued = 0;
+	m_fetchingBytes = 0;
+	m_fetchDoneAt = 0;
+}
+
+void BusInterfaceUnit::Prefetch(int64_t until)
+{
+	const bool b8088 = m_chip.cpuTarget == Estimator::CpuTarget::i8088;
+	const uint32_t queueSize = b8088 ? 4 : 6;
+
+	while (true)
+	{
+		if (m_fetchingBytes > 0)
+		{
+			if (m_fetchDoneAt > until)
+			{
+				return;
+			}
+
+			m_queued += m_fetchingBytes;
+			m_fetchingBytes = 0;
+		}
+
+		// The 8086 fetches aligned words, a single byte to get back on an even address.
+		const uint32_t fetchBytes = b8088 || (m_fetchIp & 1) ? 1 : 2;
+
+		if (m_queued + fetchBytes > queueSize || m_busFreeAt >= until)
+		{
+			return;
+		}
+
+		m_fetchingBytes = fetchBytes;
+		m_fetchIp += fetchBytes;
+		m_fetchDoneAt = m_busFreeAt + busCycleClocks;
+		m_busFreeAt = m_fetchDoneAt;
+	}
+}
+
+int32_t BusInterfaceUnit::Execute(const DecodedInstruction& decodedInst, uint32_t ip, uint32_t nextIp, int32_t bookClocks)
+{
+	const int64_t previousEnd = totalClocks;
+	int64_t now = totalClocks;
+
+	// Take the instruction's bytes from the queue as they arrive.
+	uint32_t remaining = static_cast<uint32_t>(decodedInst.extraBits + 1);
+	while (true)
+	{
+		Prefetch(now);
+
+		const uint32_t taken = std::min(m_queued, remaining);
+		m_queued -= taken;
+		remaining -= taken;
+
+		if (remaining == 0)
+		{
+			break;
+		}
+
+		// Start the next fetch if there's none on the bus yet, then wait for it.
+		if (m_fetchingBytes == 0)
+		{
+			Prefetch(std::max(now, m_busFreeAt) + 1);
+		}
+
+		now = std::max(now, m_fetchDoneAt);
+	}
+
+	const int64_t start = now;
+	int64_t busWait = 0;
+
+	// Halves of split words are bus cycles of their own.
+	const int32_t busCycles = Estimator::MemoryTransfers(decodedInst) + Estimator::TransferPenalty(m_chip, decodedInst) / busCycleClocks;
+	if (busCycles > 0)
+	{
+		const int64_t request = start + std::max(0, bookClocks - busCycles * busCycleClocks);
+		Prefetch(request);
+
+		const int64_t busStart = std::max(request, m_busFreeAt);
+		busWait = busStart - request;
+		m_busFreeAt = busStart + busCycles * busCycleClocks;
+	}
+
+	now = start + bookClocks + busWait;
+
+	// A taken jump throws the queue away, a fetch still on the bus finishes but its bytes are dropped.
+	if (nextIp != ip + static_cast<uint32_t>(decodedInst.extraBits + 1))
+	{
+		Prefetch(now);
+
+		m_queued = 0;
+		m_fetchingBytes = 0;
+		m_fetchIp = nextIp;
+		m_busFreeAt = std::max(m_busFreeAt, now);
+	}
+
+	totalClocks = now;
+
+	return static_cast<int32_t>(now - previousEnd);
+}
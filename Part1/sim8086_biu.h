@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+struct DecodedInstruction;
+struct VirtualChip;
+
+// Cycle model of the 8086's bus interface unit, used by -biu to time instructions the way the chip would
+// rather than by the book. The BIU prefetches code into its queue (6 bytes on an 8086, 4 on an 8088, see
+// VirtualChip::cpuTarget) whenever the bus is free and the queue has room, one bus cycle of 4 clocks per fetch.
+// The EU takes instruction bytes from the queue, waiting when they aren't there yet, and takes the bus over
+// for its own memory transfers at the end of its book clocks, waiting for a prefetch that's already underway.
+// A taken jump flushes the queue and prefetching starts over at the target.
+class BusInterfaceUnit
+{
+public:
+	// Times instructions run on chip.
+	explicit BusInterfaceUnit(const VirtualChip& chip);
+
+	// Starts over with an empty queue fetching from ip.
+	void Reset(uint32_t ip);
+
+	// Times the instruction that just ran at ip, given its book clocks. Returns the clocks from the end of the
+	// previous instruction to the end of this one, which also go into totalClocks.
+	int32_t Execute(const DecodedInstruction& decodedInst, uint32_t ip, uint32_t nextIp, int32_t bookClocks);
+
+	int64_t totalClocks = 0;
+
+private:
+	// Runs every prefetch bus cycle that starts before time until.
+	void Prefetch(int64_t until);
+
+	const VirtualChip& m_chip;
+
+	// Clock the bus is free from.
+	int64_t m_busFreeAt = 0;
+
+	// Next code byte to fetch.
+	uint32_t m_fetchIp = 0;
+	uint32_t m_queued = 0;
+
+	// The fetch on the bus, its bytes join the queue at m_fetchDoneAt.
+	uint32_t m_fetchingBytes = 0;
+	int64_t m_fetchDoneAt = 0;
+};
@@ -0,0 +1,522 @@
+#include <cassert>
+#include <algorithm>
+
+#include "sim8086.h"
+#include "sim8086_blocks.h"
+#include "sim8086_decoder.h"
+#include "sim8086_estimation.h"
+#include "sim8086_jit.h"
+
+enum class OperandKind : uint8_t
+{
+	ok_bound,
+	ok_computed,
+	ok_immediate
+};
+
+// Stands in for the base or index register an addressing mode doesn't have.
+static const uint16_t zeroRegister = 0;
+
+static bool IsBranch(OpCode opCode)
+{
+	return opCode >= OpCode::op_je && opCode <= OpCode::op_jcxz;
+}
+
+static inline uint16_t AddressIndex(const OperandBinding& binding)
+{
+	return static_cast<uint16_t>(*binding.base + *binding.index + binding.displacement);
+}
+
+template <OperandKind kind>
+static inline uint8_t* Resolve(VirtualChip& chip, const OperandBinding& binding)
+{
+	if constexpr (kind == OperandKind::ok_computed)
+	{
+		return &chip.m_memory[AddressIndex(binding)];
+	}
+	else
+	{
+		return binding.bound;
+	}
+}
+
+// Applies all but the last of the iterations the counted loop has left in closed form, as if the block had run
+// that many times. The last one runs normally so flags and the exit end up as stepping would leave them.
+static void FastForward(VirtualChip& chip, Block& block, BlockEngine& engine)
+{
+	const CountedLoop& loop = block.loop;
+	const uint16_t cx = chip[1];
+
+	// Times the body is about to run, counting the one that exits.
+	const uint32_t iterations = loop.counter == OpCode::op_loop ? cx + 1u : (cx == 0 ? 0x10000u : cx);
+	uint32_t skipped = iterations - 1;
+
+	// Stop skipping where the instruction limit would have stopped stepping.
+	if (engine.instructionLimit != UINT64_MAX)
+	{
+		const uint64_t allowed = engine.instructionLimit > engine.instructionsExecuted ?
+			(engine.instructionLimit - engine.instructionsExecuted) / block.instructionCount : 0;
+		skipped = static_cast<uint32_t>(std::min<uint64_t>(skipped, allowed));
+	}
+
+	if (skipped == 0)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < 8; ++i)
+	{
+		if (loop.resetMask & (1 << i))
+		{
+			chip[i] = loop.delta[i];
+		}
+		else
+		{
+			chip[i] = static_cast<uint16_t>(chip[i] + skipped * loop.delta[i]);
+		}
+	}
+
+	// loop and loopz count cx down themselves.
+	if (loop.counter != OpCode::op_jne)
+	{
+		chip[1] = static_cast<uint16_t>(cx - skipped);
+	}
+
+	chip.totalClocks += static_cast<int64_t>(skipped) * (block.clocks + block.takenClocks);
+	engine.instructionsExecuted += static_cast<uint64_t>(skipped) * block.instructionCount;
+}
+
+ThreadedOp* LeaveBlock(ThreadedOp* op, bool bTaken)
+{
+	const Block& block = *op->block;
+	VirtualChip& chip = *op->chip;
+
+	chip.totalClocks += block.clocks;
+	op->engine->instructionsExecuted += block.instructionCount;
+
+	uint32_t nextIp = block.endIp;
+	Block** successor = &op->next;
+
+	if (bTaken)
+	{
+		chip.totalClocks += block.takenClocks;
+		nextIp = op->takenIp;
+		successor = &op->taken;
+	}
+
+	chip.ip_register = nextIp;
+
+	BlockEngine& engine = *op->engine;
+
+	if (!*successor)
+	{
+		*successor = engine.GetBlock(nextIp);
+
+		if (!*successor)
+		{
+			return nullptr;
+		}
+	}
+
+	// Translation rewrites the successor's ops in place, op may be one of them so it's not used past here.
+	Block& nextBlock = **successor;
+
+	if (engine.instructionsExecuted >= engine.instructionLimit)
+	{
+		return nullptr;
+	}
+
+	if (bTaken && nextBlock.loop.bValid && &nextBlock == &block)
+	{
+		FastForward(chip, nextBlock, engine);
+	}
+
+	if (engine.jit && ++nextBlock.executionCount == Jit::hotThreshold)
+	{
+		engine.jit->Compile(nextBlock);
+	}
+
+	return nextBlock.ops.data();
+}
+
+// Takes the branch that closes the block if there is one.
+static ThreadedOp* ExitBlock(ThreadedOp* op)
+{
+	return LeaveBlock(op, op->opCode != OpCode::op_undefined && Simulator::BranchTaken(*op->chip, op->opCode));
+}
+
+// Fused ops are the last instruction before the branch closing their block and leave the block themselves.
+template <OpCode opCode, typename T, OperandKind destKind, OperandKind sourceKind, bool bFused>
+static ThreadedOp* ExecuteArithmetic(ThreadedOp* op)
+{
+	VirtualChip& chip = *op->chip;
+	T& dest = *reinterpret_cast<T*>(Resolve<destKind>(chip, op->dest));
+
+	// Word cmp is the only one that leaves its destination alone.
+	if constexpr (destKind == OperandKind::ok_computed && !(opCode == OpCode::op_cmp && sizeof(T) == 2))
+	{
+		chip.MarkDirty(AddressIndex(op->dest), sizeof(T));
+	}
+
+	T source{};
+	if constexpr (sourceKind == OperandKind::ok_immediate)
+	{
+		source = static_cast<T>(op->immediate);
+	}
+	else
+	{
+		source = *reinterpret_cast<const T*>(Resolve<sourceKind>(chip, op->source));
+	}
+
+	if constexpr (sizeof(T) == 2 && (destKind == OperandKind::ok_computed || sourceKind == OperandKind::ok_computed))
+	{
+		const OperandBinding& memory = destKind == OperandKind::ok_computed ? op->dest : op->source;
+		chip.totalClocks += (AddressIndex(memory) & 1) ? op->oddPenalty : 0;
+	}
+
+	Simulator::Arithmetic<opCode>(chip, dest, source);
+
+	if constexpr (bFused)
+	{
+		ThreadedOp* exitOp = op + 1;
+
+		// The flags the branch reads are the ones just recorded, no need to go through GetFlag.
+		if constexpr (opCode != OpCode::op_mov)
+		{
+			const LazyFlags& lazy = chip.m_lazyFlags;
+			return LeaveBlock(exitOp, Simulator::BranchTaken(chip, exitOp->opCode, [&chip, &lazy](size_t bit) { return Simulator::ComputeFlag(chip, lazy, bit); }));
+		}
+		else
+		{
+			return LeaveBlock(exitOp, Simulator::BranchTaken(chip, exitOp->opCode, [&chip](size_t bit) { return Simulator::GetFlag(chip, bit); }));
+		}
+	}
+	else
+	{
+		return op + 1;
+	}
+}
+
+// Instructions without a simulated effect still pay for a word at an odd address.
+static ThreadedOp* ChargeOddAddress(ThreadedOp* op)
+{
+	const OperandBinding& memory = op->dest.base ? op->dest : op->source;
+	op->chip->totalClocks += (AddressIndex(memory) & 1) ? op->oddPenalty : 0;
+
+	return op + 1;
+}
+
+template <OpCode opCode, typename T, OperandKind destKind, OperandKind sourceKind>
+static OpHandler SelectHandler(bool bFused)
+{
+	return bFused ? &ExecuteArithmetic<opCode, T, destKind, sourceKind, true> : &ExecuteArithmetic<opCode, T, destKind, sourceKind, false>;
+}
+
+template <OpCode opCode, typename T, OperandKind destKind>
+static OpHandler SelectHandler(OperandKind sourceKind, bool bFused)
+{
+	switch (sourceKind)
+	{
+	case OperandKind::ok_bound:
+		return SelectHandler<opCode, T, destKind, OperandKind::ok_bound>(bFused);
+	case OperandKind::ok_computed:
+		return SelectHandler<opCode, T, destKind, OperandKind::ok_computed>(bFused);
+	default:
+		return SelectHandler<opCode, T, destKind, OperandKind::ok_immediate>(bFused);
+	}
+}
+
+template <OpCode opCode, typename T>
+static OpHandler SelectHandler(OperandKind destKind, OperandKind sourceKind, bool bFused)
+{
+	if (destKind == OperandKind::ok_computed)
+	{
+		return SelectHandler<opCode, T, OperandKind::ok_computed>(sourceKind, bFused);
+	}
+
+	return SelectHandler<opCode, T, OperandKind::ok_bound>(sourceKind, bFused);
+}
+
+template <OpCode opCode>
+static OpHandler SelectHandler(bool bWord, OperandKind destKind, OperandKind sourceKind, bool bFused)
+{
+	return bWord ? SelectHandler<opCode, uint16_t>(destKind, sourceKind, bFused) : SelectHandler<opCode, uint8_t>(destKind, sourceKind, bFused);
+}
+
+static OpHandler SelectHandler(OpCode opCode, bool bWord, OperandKind destKind, OperandKind sourceKind, bool bFused = false)
+{
+	switch (opCode)
+	{
+	case OpCode::op_mov:
+		return SelectHandler<OpCode::op_mov>(bWord, destKind, sourceKind, bFused);
+	case OpCode::op_add:
+		return SelectHandler<OpCode::op_add>(bWord, destKind, sourceKind, bFused);
+	case OpCode::op_sub:
+		return SelectHandler<OpCode::op_sub>(bWord, destKind, sourceKind, bFused);
+	case OpCode::op_cmp:
+		return SelectHandler<OpCode::op_cmp>(bWord, destKind, sourceKind, bFused);
+	default:
+		return nullptr;
+	}
+}
+
+static const uint16_t* RegisterAddress(VirtualChip& chip, Register reg)
+{
+	return reg == Register::reg_none ? &zeroRegister : &chip[static_cast<size_t>(reg)];
+}
+
+// Memory that's written is never bound, the handler has to know its address to mark the page dirty.
+static OperandKind Bind(VirtualChip& chip, const Operand& operand, OperandType operandType, OperandBinding& binding, bool bWritten)
+{
+	switch (operandType)
+	{
+	case OperandType::ot_register:
+	case OperandType::ot_accumulator:
+		binding.bound = &chip.m_registers.Byte(operand.reg);
+		return OperandKind::ok_bound;
+
+	case OperandType::ot_memory:
+		if (!bWritten && operand.address.base == Register::reg_none && operand.address.index == Register::reg_none)
+		{
+			binding.bound = &chip.m_memory[static_cast<uint16_t>(operand.address.displacement)];
+			return OperandKind::ok_bound;
+		}
+
+		binding.base = RegisterAddress(chip, operand.address.base);
+		binding.index = RegisterAddress(chip, operand.address.index);
+		binding.displacement = static_cast<uint16_t>(operand.address.displacement);
+		return OperandKind::ok_computed;
+
+	default:
+		return OperandKind::ok_immediate;
+	}
+}
+
+BlockEngine::BlockEngine(VirtualChip& chip)
+	: m_chip(chip)
+{
+}
+
+void BlockEngine::Run()
+{
+	Block* block = GetBlock(m_chip.ip_register);
+	ThreadedOp* op = block ? block->ops.data() : nullptr;
+
+	while (op)
+	{
+		op = op->handler(op);
+	}
+}
+
+Block* BlockEngine::GetBlock(uint32_t ip)
+{
+	if (ip >= m_chip.m_programSize)
+	{
+		return nullptr;
+	}
+
+	if (m_blocks.size() != m_chip.m_programSize)
+	{
+		m_blocks.resize(m_chip.m_programSize);
+	}
+
+	if (!m_blocks[ip])
+	{
+		m_blocks[ip] = Compile(ip);
+	}
+
+	return m_blocks[ip].get();
+}
+
+// Whether the block is a loop FastForward can skip through: it has to branch back to its own start, only do
+// word mov, add, sub and cmp of registers with immediates, and be counted by cx alone.
+static CountedLoop AnalyzeLoop(const VirtualChip& chip, const Block& block)
+{
+	CountedLoop loop{};
+
+	const DecodedInstruction& branch = block.instructions.back();
+	if (!IsBranch(branch.opCode) || block.endIp + branch.destTarget != block.startIp)
+	{
+		return loop;
+	}
+
+	const DecodedInstruction* lastFlagsInst = nullptr;
+
+	for (size_t i = 0; i + 1 < block.instructions.size(); ++i)
+	{
+		const DecodedInstruction& decodedInst = block.instructions[i];
+
+		// Unless its clocks depend on the address it reads.
+		if (decodedInst.opCode == OpCode::op_test && Estimator::DynamicPenalty(chip, decodedInst) == 0)
+		{
+			continue;
+		}
+
+		const bool bRegisterDest = decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator;
+		if (decodedInst.opCode < OpCode::op_mov || decodedInst.opCode > OpCode::op_cmp || !decodedInst.bWord ||
+			!bRegisterDest || decodedInst.SourceOT != OperandType::ot_immediate)
+		{
+			return loop;
+		}
+
+		const size_t index = static_cast<size_t>(decodedInst.Dest.reg.index);
+		const uint16_t immediate = static_cast<uint16_t>(decodedInst.Source.immediate);
+
+		switch (decodedInst.opCode)
+		{
+		case OpCode::op_mov:
+			loop.resetMask |= static_cast<uint8_t>(1 << index);
+			loop.delta[index] = immediate;
+			break;
+		case OpCode::op_add:
+			loop.delta[index] += immediate;
+			lastFlagsInst = &decodedInst;
+			break;
+		case OpCode::op_sub:
+			loop.delta[index] -= immediate;
+			lastFlagsInst = &decodedInst;
+			break;
+		default:
+			lastFlagsInst = &decodedInst;
+			break;
+		}
+	}
+
+	const bool bCxUntouched = !(loop.resetMask & 2) && loop.delta[1] == 0;
+
+	switch (branch.opCode)
+	{
+	case OpCode::op_loop:
+	case OpCode::op_loopz:
+		if (!bCxUntouched)
+		{
+			return loop;
+		}
+		break;
+
+	// jnz exits once cx reaches 0 when the body's last flags come from counting cx down by one.
+	case OpCode::op_jne:
+		if (!lastFlagsInst || lastFlagsInst->opCode == OpCode::op_cmp || lastFlagsInst->Dest.reg.index != Register::reg_cx ||
+			(loop.resetMask & 2) || loop.delta[1] != 0xffff)
+		{
+			return loop;
+		}
+		break;
+
+	// Everything else exits on data.
+	default:
+		return loop;
+	}
+
+	loop.bValid = true;
+	loop.counter = branch.opCode;
+
+	return loop;
+}
+
+// Only called right before the block runs for the first time, which is when its destination registers
+// count as mutated.
+std::unique_ptr<Block> BlockEngine::Compile(uint32_t ip)
+{
+	std::unique_ptr<Block> block = std::make_unique<Block>();
+	block->startIp = ip;
+
+	while (ip < m_chip.m_programSize && block->instructions.size() < Block::maxInstructions)
+	{
+		DecodedInstruction decodedInst;
+		Decoder::Disasm(m_chip, ip, decodedInst);
+
+		ip += static_cast<uint32_t>(decodedInst.extraBits + 1);
+		block->instructions.push_back(decodedInst);
+
+		if (IsBranch(decodedInst.opCode))
+		{
+			break;
+		}
+	}
+
+	block->endIp = ip;
+
+	block->instructionCount = static_cast<uint32_t>(block->instructions.size());
+	block->loop = AnalyzeLoop(m_chip, *block);
+	block->ops.reserve(block->instructions.size() + 1);
+
+	// Last op that made it into the block, for fusing it with the closing branch.
+	const DecodedInstruction* lastOpInst = nullptr;
+	OperandKind lastDestKind{};
+	OperandKind lastSourceKind{};
+
+	for (const DecodedInstruction& decodedInst : block->instructions)
+	{
+		int32_t estimatedClocks = 0;
+		int32_t ea = 0;
+		Estimator::EstimateClocks(decodedInst, estimatedClocks, ea);
+		block->clocks += estimatedClocks + ea + Estimator::StaticPenalty(m_chip, decodedInst);
+
+		if (IsBranch(decodedInst.opCode))
+		{
+			int32_t takenClocks = 0;
+			Estimator::EstimateClocks(decodedInst, takenClocks, ea, true);
+			block->takenClocks = takenClocks - estimatedClocks;
+		}
+
+		if (decodedInst.opCode == OpCode::op_undefined || IsBranch(decodedInst.opCode))
+		{
+			continue;
+		}
+
+		if (decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator)
+		{
+			m_chip.AddUniqueMutatedRegister(static_cast<size_t>(decodedInst.Dest.reg.index));
+		}
+
+		ThreadedOp op{};
+		op.chip = &m_chip;
+		op.instruction = static_cast<uint16_t>(&decodedInst - block->instructions.data());
+		const OperandKind destKind = Bind(m_chip, decodedInst.Dest, decodedInst.DestOT, op.dest, true);
+		const OperandKind sourceKind = Bind(m_chip, decodedInst.Source, decodedInst.SourceOT, op.source, false);
+		op.immediate = static_cast<uint16_t>(decodedInst.Source.immediate);
+		op.oddPenalty = Estimator::DynamicPenalty(m_chip, decodedInst);
+		op.handler = SelectHandler(decodedInst.opCode, decodedInst.bWord, destKind, sourceKind);
+
+		// test has no effect on the simulated state yet.
+		if (op.handler)
+		{
+			block->ops.push_back(op);
+
+			lastOpInst = &decodedInst;
+			lastDestKind = destKind;
+			lastSourceKind = sourceKind;
+		}
+		else if (op.oddPenalty > 0)
+		{
+			op.handler = &ChargeOddAddress;
+			block->ops.push_back(op);
+
+			lastOpInst = nullptr;
+		}
+	}
+
+	ThreadedOp exitOp{};
+	exitOp.handler = &ExitBlock;
+	exitOp.block = block.get();
+	exitOp.engine = this;
+	exitOp.chip = &m_chip;
+
+	const DecodedInstruction& lastInst = block->instructions.back();
+	if (IsBranch(lastInst.opCode))
+	{
+		exitOp.opCode = lastInst.opCode;
+		exitOp.takenIp = block->endIp + lastInst.destTarget;
+
+		// cmp + jcc, sub cx + jnz, add + loop and the like run as one op. Clocks stay per instruction, see block->clocks.
+		if (lastOpInst)
+		{
+			block->ops.back().handler = SelectHandler(lastOpInst->opCode, lastOpInst->bWord, lastDestKind, lastSourceKind, true);
+		}
+	}
+
+	block->ops.push_back(exitOp);
+
+	return block;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "sim8086_decoder.h"
+
+struct ThreadedOp;
+struct Block;
+class BlockEngine;
+class Jit;
+struct NativeFrame;
+
+using OpHandler = ThreadedOp* (*)(ThreadedOp* op);
+
+// Where an operand lives, resolved when its block is compiled.
+struct OperandBinding
+{
+	// Register, direct memory address.
+	uint8_t* bound = nullptr;
+
+	// Effective address registers of every other memory operand, pointing at zero for the ones the mode lacks.
+	const uint16_t* base = nullptr;
+	const uint16_t* index = nullptr;
+	uint16_t displacement = 0;
+};
+
+// One instruction of a compiled block. The handler executes it and returns the op to run next.
+struct ThreadedOp
+{
+	OpHandler handler = nullptr;
+
+	OperandBinding dest{};
+	OperandBinding source{};
+	uint16_t immediate = 0;
+
+	// Position of the op's instruction in its block's instructions.
+	uint16_t instruction = 0;
+
+	// Clocks added when the memory operand addressed through registers turns out to be odd.
+	int32_t oddPenalty = 0;
+
+	// What the op runs on, the chip of the engine that compiled it.
+	VirtualChip* chip = nullptr;
+
+	// Translated block, see Jit. Returns the op to carry on with.
+	ThreadedOp* (*native)(uint16_t* registers, uint8_t* memory, NativeFrame* frame) = nullptr;
+
+	// Only used by the op closing a block.
+	OpCode opCode = OpCode::op_undefined;
+	uint32_t takenIp = 0;
+	Block* block = nullptr;
+	Block* taken = nullptr;
+	Block* next = nullptr;
+	BlockEngine* engine = nullptr;
+};
+
+// A block that branches back to itself with a body of nothing but word register arithmetic with immediates,
+// so any number of its iterations can be applied at once.
+struct CountedLoop
+{
+	bool bValid = false;
+
+	// op_loop, op_loopz, or op_jne after the body counts cx down by one.
+	OpCode counter = OpCode::op_undefined;
+
+	// Per iteration register i becomes delta[i], plus its old value unless bit i of resetMask is set.
+	uint16_t delta[8]{};
+	uint8_t resetMask = 0;
+};
+
+// Straight line code from startIp up to and including a jump, loop or jcxz, or up to the end of the program.
+struct Block
+{
+	uint32_t startIp = 0;
+	uint32_t endIp = 0;
+
+	uint32_t instructionCount = 0;
+	// With the closing branch not taken, a taken one adds takenClocks.
+	int32_t clocks = 0;
+	int32_t takenClocks = 0;
+
+	uint32_t executionCount = 0;
+
+	CountedLoop loop{};
+
+	// Set once the Jit translated the block: where its code carries on when another translated block jumps to
+	// it, and the successors its own code jumps to instead of returning, as they get translated too.
+	const uint8_t* nativeEntry = nullptr;
+	const uint8_t* nativeTaken = nullptr;
+	const uint8_t* nativeNext = nullptr;
+
+	std::vector<DecodedInstruction> instructions{};
+	std::vector<ThreadedOp> ops{};
+
+	// So ThreadedOp::instruction can tell them all apart, longer straight line code is split.
+	static constexpr size_t maxInstructions = UINT16_MAX;
+};
+
+// Accounts for the block exitOp closes and returns the first op of the block execution continues in, or
+// nullptr once the program or the instruction limit has run out.
+ThreadedOp* LeaveBlock(ThreadedOp* exitOp, bool bTaken);
+
+// Runs the program a basic block at a time instead of decoding, resolving and switching per instruction.
+// Blocks are compiled the first time execution reaches them and stay linked to the blocks they branch to.
+class BlockEngine
+{
+public:
+	explicit BlockEngine(VirtualChip& chip);
+
+	// Executes from chip.ip_register until ip leaves the program, or until instructionsExecuted reaches
+	// instructionLimit, which is only checked between blocks. Run again to carry on from there.
+	void Run();
+
+	// Block starting at ip, compiled on first use. nullptr once ip is outside the program.
+	Block* GetBlock(uint32_t ip);
+
+	uint64_t instructionsExecuted = 0;
+	uint64_t instructionLimit = UINT64_MAX;
+
+	// Translates blocks once they turn hot when set.
+	Jit* jit = nullptr;
+
+private:
+	std::unique_ptr<Block> Compile(uint32_t ip);
+
+	VirtualChip& m_chip;
+	std::vector<std::unique_ptr<Block>> m_blocks{};
+};
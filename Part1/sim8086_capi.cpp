@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "sim8086.h"
+#include "sim8086_blocks.h"
+#include "sim8086_capi.h"
+#include "sim8086_decoder.h"
+#include "sim8086_estimation.h"
+#include "sim8086_loader.h"
+
+struct sim8086_context
+{
+	VirtualChip chip{};
+
+	// The caller's bytes followed by ProgramImage::padding zeros, like a program the CLI loads.
+	std::vector<uint8_t> program{};
+	DecodeCache decodeCache{};
+
+	// Compiled on the first sim8086_run after a load, the blocks point into chip.
+	std::unique_ptr<BlockEngine> blockEngine{};
+
+	// Since the last load, what sim8086_clocks and sim8086_instructions report.
+	uint64_t clocks = 0;
+	uint64_t instructions = 0;
+};
+
+static bool IsBranch(OpCode opCode)
+{
+	return opCode >= OpCode::op_je && opCode <= OpCode::op_jcxz;
+}
+
+static uint8_t RegisterIndex(Register reg)
+{
+	return reg == Register::reg_none ? static_cast<uint8_t>(SIM8086_REG_NONE) : static_cast<uint8_t>(reg);
+}
+
+static void FillOperand(sim8086_operand& operand, const Operand& source, OperandType type)
+{
+	switch (type)
+	{
+	case OperandType::ot_register:
+	case OperandType::ot_accumulator:
+		operand.type = SIM8086_OPERAND_REGISTER;
+		operand.reg = RegisterIndex(source.reg.index);
+		operand.high = source.reg.offset;
+		operand.size = source.reg.count;
+		break;
+
+	case OperandType::ot_memory:
+		operand.type = SIM8086_OPERAND_MEMORY;
+		operand.base = RegisterIndex(source.address.base);
+		operand.index = RegisterIndex(source.address.index);
+		operand.displacement = source.address.displacement;
+		break;
+
+	case OperandType::ot_immediate:
+		operand.type = SIM8086_OPERAND_IMMEDIATE;
+		operand.value = source.immediate;
+		break;
+
+	default:
+		break;
+	}
+}
+
+sim8086_context* sim8086_create(void)
+{
+	try
+	{
+		return new sim8086_context{};
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+}
+
+void sim8086_destroy(sim8086_context* context)
+{
+	delete context;
+}
+
+sim8086_status sim8086_load(sim8086_context* context, const uint8_t* program, size_t size)
+{
+	if (!context || (!program && size > 0))
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	try
+	{
+		const Estimator::CpuTarget cpuTarget = context->chip.cpuTarget;
+
+		context->blockEngine.reset();
+		context->chip = VirtualChip{};
+		context->chip.cpuTarget = cpuTarget;
+
+		context->program.assign(program, program + size);
+		context->program.resize(size + ProgramImage::padding);
+
+		context->chip.m_program = context->program.data();
+		context->chip.m_programSize = size;
+		context->decodeCache.Reset(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		context->program.clear();
+		context->chip.m_program = nullptr;
+		context->chip.m_programSize = 0;
+		return SIM8086_OUT_OF_MEMORY;
+	}
+
+	context->clocks = 0;
+	context->instructions = 0;
+
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_set_cpu(sim8086_context* context, sim8086_cpu cpu)
+{
+	if (!context || (cpu != SIM8086_CPU_8086 && cpu != SIM8086_CPU_8088))
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	const Estimator::CpuTarget cpuTarget = cpu == SIM8086_CPU_8088 ? Estimator::CpuTarget::i8088 : Estimator::CpuTarget::i8086;
+	if (cpuTarget != context->chip.cpuTarget)
+	{
+		// Compiled blocks have the transfer penalties of the old target in them.
+		context->blockEngine.reset();
+		context->chip.cpuTarget = cpuTarget;
+	}
+
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_decode(const sim8086_context* context, uint32_t ip, sim8086_instruction* instruction)
+{
+	if (!context || !instruction)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	if (ip >= context->chip.m_programSize)
+	{
+		return SIM8086_NO_PROGRAM;
+	}
+
+	DecodedInstruction decodedInst;
+	Decoder::Disasm(context->chip, ip, decodedInst);
+
+	*instruction = sim8086_instruction{};
+	instruction->ip = ip;
+	instruction->size = static_cast<uint8_t>(decodedInst.extraBits + 1);
+	instruction->is_word = decodedInst.bWord;
+	instruction->is_branch = IsBranch(decodedInst.opCode);
+
+	if (decodedInst.opCode != OpCode::op_undefined)
+	{
+		if (decodedInst.DestOT == OperandType::ot_jumpTarget)
+		{
+			instruction->dest.type = SIM8086_OPERAND_JUMP_TARGET;
+			instruction->dest.value = decodedInst.destTarget;
+		}
+		else
+		{
+			FillOperand(instruction->dest, decodedInst.Dest, decodedInst.DestOT);
+			FillOperand(instruction->source, decodedInst.Source, decodedInst.SourceOT);
+		}
+	}
+
+	Estimator::EstimateClocks(decodedInst, instruction->clocks, instruction->ea_clocks);
+	instruction->clocks += instruction->ea_clocks;
+
+	if (instruction->is_branch)
+	{
+		int32_t ea = 0;
+		Estimator::EstimateClocks(decodedInst, instruction->clocks_taken, ea, true);
+	}
+	else
+	{
+		instruction->clocks_taken = instruction->clocks;
+	}
+
+	const std::string mnemonic = OpcodeToString(decodedInst.opCode);
+	std::strncpy(instruction->mnemonic, mnemonic.c_str(), sizeof(instruction->mnemonic) - 1);
+
+	std::ostringstream text{};
+	text << decodedInst;
+	std::strncpy(instruction->text, text.str().c_str(), sizeof(instruction->text) - 1);
+
+	return decodedInst.opCode == OpCode::op_undefined ? SIM8086_UNDEFINED_INSTRUCTION : SIM8086_OK;
+}
+
+sim8086_status sim8086_step(sim8086_context* context, uint64_t count, uint64_t* executed)
+{
+	if (!context)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	VirtualChip& chip = context->chip;
+	uint64_t steps = 0;
+
+	while (steps < count && chip.ip_register < chip.m_programSize)
+	{
+		DecodedInstruction decodedInst = context->decodeCache.Fetch(chip);
+		const bool bBranchTaken = Simulator::ExecuteInstruction(chip, decodedInst);
+
+		int32_t estimatedClocks = 0;
+		int32_t ea = 0;
+		Estimator::EstimateClocks(decodedInst, estimatedClocks, ea, bBranchTaken);
+
+		const int32_t clocks = estimatedClocks + ea + Estimator::TransferPenalty(chip, decodedInst);
+		chip.totalClocks += clocks;
+		context->clocks += static_cast<uint64_t>(clocks);
+
+		++steps;
+	}
+
+	context->instructions += steps;
+	if (executed)
+	{
+		*executed = steps;
+	}
+
+	return steps == 0 && count > 0 ? SIM8086_NO_PROGRAM : SIM8086_OK;
+}
+
+sim8086_status sim8086_run(sim8086_context* context, uint64_t count, uint64_t* executed)
+{
+	if (!context)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	VirtualChip& chip = context->chip;
+	if (chip.ip_register >= chip.m_programSize)
+	{
+		if (executed)
+		{
+			*executed = 0;
+		}
+
+		return count > 0 ? SIM8086_NO_PROGRAM : SIM8086_OK;
+	}
+
+	if (!context->blockEngine)
+	{
+		try
+		{
+			context->blockEngine = std::make_unique<BlockEngine>(chip);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return SIM8086_OUT_OF_MEMORY;
+		}
+	}
+
+	BlockEngine& blockEngine = *context->blockEngine;
+	const uint64_t startInstructions = blockEngine.instructionsExecuted;
+	const int64_t startClocks = chip.totalClocks;
+
+	blockEngine.instructionLimit = startInstructions + std::min(count, UINT64_MAX - startInstructions);
+	blockEngine.Run();
+
+	const uint64_t steps = blockEngine.instructionsExecuted - startInstructions;
+	context->clocks += static_cast<uint64_t>(chip.totalClocks - startClocks);
+	context->instructions += steps;
+
+	if (executed)
+	{
+		*executed = steps;
+	}
+
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_read_register(sim8086_context* context, sim8086_register reg, uint16_t* value)
+{
+	if (!context || !value)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	if (reg >= SIM8086_REG_AX && reg <= SIM8086_REG_DI)
+	{
+		*value = context->chip[static_cast<size_t>(reg)];
+	}
+	else if (reg == SIM8086_REG_IP)
+	{
+		*value = static_cast<uint16_t>(context->chip.ip_register);
+	}
+	else if (reg == SIM8086_REG_FLAGS)
+	{
+		*value = static_cast<uint16_t>(Simulator::GetFlags(context->chip).to_ulong());
+	}
+	else
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_write_register(sim8086_context* context, sim8086_register reg, uint16_t value)
+{
+	if (!context)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	VirtualChip& chip = context->chip;
+
+	if (reg >= SIM8086_REG_AX && reg <= SIM8086_REG_DI)
+	{
+		chip[static_cast<size_t>(reg)] = value;
+		chip.AddUniqueMutatedRegister(static_cast<size_t>(reg));
+	}
+	else if (reg == SIM8086_REG_IP)
+	{
+		chip.ip_register = value;
+	}
+	else if (reg == SIM8086_REG_FLAGS)
+	{
+		// Pending arithmetic flags would overwrite the ones written.
+		chip.m_lazyFlags.opCode = OpCode::op_undefined;
+		chip.m_flags = std::bitset<16>(value);
+	}
+	else
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_read_memory(const sim8086_context* context, uint32_t address, void* buffer, size_t size)
+{
+	if (!context || (!buffer && size > 0) || address > VirtualChip::memorySize || size > VirtualChip::memorySize - address)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	std::memcpy(buffer, context->chip.m_memory.data() + address, size);
+	return SIM8086_OK;
+}
+
+sim8086_status sim8086_write_memory(sim8086_context* context, uint32_t address, const void* buffer, size_t size)
+{
+	if (!context || (!buffer && size > 0) || address > VirtualChip::memorySize || size > VirtualChip::memorySize - address)
+	{
+		return SIM8086_INVALID_ARGUMENT;
+	}
+
+	std::memcpy(context->chip.m_memory.data() + address, buffer, size);
+
+	// MarkDirty covers writes the size of an instruction's operand, these can span many pages.
+	for (size_t page = address >> VirtualChip::pageShift; size > 0 && page <= (address + size - 1) >> VirtualChip::pageShift; ++page)
+	{
+		context->chip.m_dirtyPages[page] = 1;
+	}
+
+	return SIM8086_OK;
+}
+
+uint64_t sim8086_clocks(const sim8086_context* context)
+{
+	return context ? context->clocks : 0;
+}
+
+uint64_t sim8086_instructions(const sim8086_context* context)
+{
+	return context ? context->instructions : 0;
+}
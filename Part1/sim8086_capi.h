@@ -0,0 +1,133 @@
+#ifndef SIM8086_CAPI_H
+#define SIM8086_CAPI_H
+
+/* C interface of libsim8086: the decoder, simulator and clock estimator without the command line around them.
+ * Every call works on the context it is given and nothing is printed. A context may be used from one thread at
+ * a time, different contexts from as many threads as there are. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM8086_API_VERSION 1
+
+typedef struct sim8086_context sim8086_context;
+
+typedef enum sim8086_status
+{
+	SIM8086_OK = 0,
+	SIM8086_INVALID_ARGUMENT,
+	SIM8086_OUT_OF_MEMORY,
+	/* Nothing loaded, or ip is outside the program. */
+	SIM8086_NO_PROGRAM,
+	/* The bytes at ip aren't an instruction the decoder knows. sim8086_instruction is still filled in, size being
+	 * how far execution would move on, the way the simulator skips such bytes. */
+	SIM8086_UNDEFINED_INSTRUCTION
+} sim8086_status;
+
+typedef enum sim8086_cpu
+{
+	SIM8086_CPU_8086 = 0,
+	SIM8086_CPU_8088
+} sim8086_cpu;
+
+/* ax to di in the order the reg field encodes them, then ip and the flags word. */
+typedef enum sim8086_register
+{
+	SIM8086_REG_AX = 0,
+	SIM8086_REG_CX,
+	SIM8086_REG_DX,
+	SIM8086_REG_BX,
+	SIM8086_REG_SP,
+	SIM8086_REG_BP,
+	SIM8086_REG_SI,
+	SIM8086_REG_DI,
+	SIM8086_REG_IP,
+	SIM8086_REG_FLAGS,
+	SIM8086_REG_NONE = 0xff
+} sim8086_register;
+
+typedef enum sim8086_operand_type
+{
+	SIM8086_OPERAND_NONE = 0,
+	SIM8086_OPERAND_REGISTER,
+	SIM8086_OPERAND_MEMORY,
+	SIM8086_OPERAND_IMMEDIATE,
+	/* Relative to the ip after the instruction. */
+	SIM8086_OPERAND_JUMP_TARGET
+} sim8086_operand_type;
+
+typedef struct sim8086_operand
+{
+	uint8_t type;
+	/* SIM8086_OPERAND_REGISTER: reg is a sim8086_register, high is 1 for ah, ch, dh and bh, size is 1 or 2 bytes. */
+	uint8_t reg;
+	uint8_t high;
+	uint8_t size;
+	/* SIM8086_OPERAND_MEMORY: base + index + displacement, SIM8086_REG_NONE where the mode has no such register. */
+	uint8_t base;
+	uint8_t index;
+	int16_t displacement;
+	/* SIM8086_OPERAND_IMMEDIATE and SIM8086_OPERAND_JUMP_TARGET. */
+	int16_t value;
+} sim8086_operand;
+
+typedef struct sim8086_instruction
+{
+	uint32_t ip;
+	uint8_t size;
+	uint8_t is_word;
+	uint8_t is_branch;
+	uint8_t reserved;
+	sim8086_operand dest;
+	sim8086_operand source;
+	/* Book clocks, the effective address clocks included. Branches cost clocks_taken when taken. Odd address and
+	 * 8088 bus penalties depend on where memory operands end up and are only added while executing. */
+	int32_t clocks;
+	int32_t clocks_taken;
+	int32_t ea_clocks;
+	char mnemonic[8];
+	/* The instruction as sim8086 disassembles it. */
+	char text[48];
+} sim8086_instruction;
+
+/* NULL when out of memory. */
+sim8086_context* sim8086_create(void);
+void sim8086_destroy(sim8086_context* context);
+
+/* Copies program and starts over from it: registers, flags, memory and clocks zeroed, ip at 0. The cpu stays. */
+sim8086_status sim8086_load(sim8086_context* context, const uint8_t* program, size_t size);
+
+/* Which bus the clocks are estimated for. 8086 until set, may change between calls to step or run. */
+sim8086_status sim8086_set_cpu(sim8086_context* context, sim8086_cpu cpu);
+
+/* Decodes the instruction at ip of the loaded program without executing it. */
+sim8086_status sim8086_decode(const sim8086_context* context, uint32_t ip, sim8086_instruction* instruction);
+
+/* Executes up to count instructions one at a time, stopping early when ip leaves the program. executed may be NULL. */
+sim8086_status sim8086_step(sim8086_context* context, uint64_t count, uint64_t* executed);
+
+/* Like sim8086_step on compiled blocks, which is much faster but only stops between blocks, so up to a block more
+ * than count may run. */
+sim8086_status sim8086_run(sim8086_context* context, uint64_t count, uint64_t* executed);
+
+/* SIM8086_REG_AX to SIM8086_REG_DI, SIM8086_REG_IP or SIM8086_REG_FLAGS. */
+sim8086_status sim8086_read_register(sim8086_context* context, sim8086_register reg, uint16_t* value);
+sim8086_status sim8086_write_register(sim8086_context* context, sim8086_register reg, uint16_t value);
+
+/* size bytes of the 1 MiB of memory from address on. */
+sim8086_status sim8086_read_memory(const sim8086_context* context, uint32_t address, void* buffer, size_t size);
+sim8086_status sim8086_write_memory(sim8086_context* context, uint32_t address, const void* buffer, size_t size);
+
+/* Estimated clocks and instructions executed since the program was loaded. */
+uint64_t sim8086_clocks(const sim8086_context* context);
+uint64_t sim8086_instructions(const sim8086_context* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
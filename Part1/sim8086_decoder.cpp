@@ -1,55 +1,63 @@
 #include "sim8086_decoder.h"
+#include <array>
 #include <cassert>
-#include <iostream>
 
-void VirtualChip::AddUniqueMutatedRegister(size_t newRegister)
+// Indexed by RM, index <= 3 == baseReg + indexReg, index > 3 && index < 6 == indexReg, else == baseReg
+static constexpr EffectiveAddress effectiveAddress[8]
 {
-    auto cond = [newRegister](const size_t& t) {return t == newRegister;};
-
-    auto it = std::find_if(m_mutatedRegisters.begin(), m_mutatedRegisters.end(), cond);
+    { Register::reg_bx, Register::reg_si },
+    { Register::reg_bx, Register::reg_di },
+    { Register::reg_bp, Register::reg_si },
+    { Register::reg_bp, Register::reg_di },
+    { Register::reg_si },
+    { Register::reg_di },
+    { Register::reg_bp },
+    { Register::reg_bx }
+};
+
+uint32_t Decoder::GetEffectiveAddressIndex(const VirtualChip& chip, const EffectiveAddress& address)
+{
+    uint16_t addressIndex = static_cast<uint16_t>(address.displacement);
 
-    if (it == m_mutatedRegisters.end())
+    if (address.base != Register::reg_none)
     {
-        m_mutatedRegisters.push_back(newRegister);
+        addressIndex += chip.m_registers[static_cast<size_t>(address.base)];
     }
-}
 
-uint32_t Decoder::GetEffectiveAddressIndex(int index, std::string& address)
-{
-    uint32_t addressIndex = 0;
-    address += Decoder::effectiveAdress[index];
-
-    addressIndex += virtualChip[Decoder::FindWordIndex(address.substr(1, 2), true)];
-
-    if (index <= 3)
+    if (address.index != Register::reg_none)
     {
-        addressIndex += virtualChip[Decoder::FindWordIndex(address.substr(6, 7), true)];
+        addressIndex += chip.m_registers[static_cast<size_t>(address.index)];
     }
 
     return addressIndex;
 }
 
-size_t Decoder::FindWordIndex(const std::string& in, bool bWord)
+void DecodeCache::Reset(size_t programSize)
 {
-    const std::string searchStr = bWord ? in : in.substr(0, 1) + "x";
+    m_slots.assign(programSize, 0);
+    m_entries.clear();
+    hits = 0;
+    misses = 0;
+}
 
-    for (size_t i{ 0 }; i < 8; ++i)
+const DecodedInstruction& DecodeCache::Fetch(const VirtualChip& chip)
+{
+    assert(chip.ip_register < m_slots.size());
+
+    uint32_t& slot = m_slots[chip.ip_register];
+    if (slot)
     {
-        if (Decoder::reg_rm_word[i] == searchStr)
-        {
-            return i;
-        }
+        ++hits;
+        return m_entries[slot - 1];
     }
 
-    return -1;
-}
+    ++misses;
 
-DecodedInstruction::DecodedInstruction()
-{
-    assert(virtualChip.ip_register);
+    DecodedInstruction& decodedInst = m_entries.emplace_back();
+    Decoder::Disasm(chip, chip.ip_register, decodedInst);
+    slot = static_cast<uint32_t>(m_entries.size());
 
-    hi = *virtualChip.ip_register & 0xFF;
-    lo = *(virtualChip.ip_register + 1) & 0xFF;
+    return decodedInst;
 }
 
 std::string OpcodeToString(OpCode opcode)
@@ -69,113 +77,164 @@ std::string OpcodeToString(OpCode opcode)
     return result;
 }
 
-std::ostream& operator<<(std::ostream& out, const DecodedInstruction& decodedInst)
+static void PrintRegister(std::ostream& out, const RegisterAccess& reg)
+{
+    if (reg.index == Register::reg_none)
+    {
+        return;
+    }
+
+    const size_t index = static_cast<size_t>(reg.index);
+    out << (reg.count == 2 ? Decoder::reg_rm_word[index] : Decoder::reg_rm_byte[index + 4 * reg.offset]);
+}
+
+static void PrintEffectiveAddress(std::ostream& out, const EffectiveAddress& address)
 {
-    out << OpcodeToString(decodedInst.opCode) << " " + decodedInst.Dest;
+    out << '[';
 
-    if (decodedInst.Source.length() > 0)
+    // Direct address
+    if (address.base == Register::reg_none && address.index == Register::reg_none)
     {
-        out << ", " + decodedInst.Source;
+        out << static_cast<uint16_t>(address.displacement) << ']';
+        return;
     }
 
-    return out;
+    if (address.base != Register::reg_none)
+    {
+        out << Decoder::reg_rm_word[static_cast<size_t>(address.base)];
+    }
+
+    if (address.index != Register::reg_none)
+    {
+        if (address.base != Register::reg_none)
+        {
+            out << " + ";
+        }
+
+        out << Decoder::reg_rm_word[static_cast<size_t>(address.index)];
+    }
+
+    if (address.displacement < 0)
+    {
+        out << " - " << -static_cast<int32_t>(address.displacement);
+    }
+    else if (address.displacement > 0)
+    {
+        out << " + " << address.displacement;
+    }
+
+    out << ']';
 }
 
-static std::string getRegisterName(const std::bitset<3>& bits, bool bWord)
+static void PrintOperand(std::ostream& out, const DecodedInstruction& decodedInst, const Operand& operand, OperandType operandType)
+{
+    switch (operandType)
+    {
+    case OperandType::ot_register:
+    case OperandType::ot_accumulator:
+        PrintRegister(out, operand.reg);
+        break;
+
+    case OperandType::ot_memory:
+        PrintEffectiveAddress(out, operand.address);
+        break;
+
+    case OperandType::ot_immediate:
+        out << operand.immediate;
+        break;
+
+    case OperandType::ot_jumpTarget:
+        out << '$' << (decodedInst.destTarget >= 0 ? "+" : "") << decodedInst.destTarget + 2;
+        break;
+    }
+}
+
+std::ostream& operator<<(std::ostream& out, const DecodedInstruction& decodedInst)
 {
-    const size_t index = static_cast<size_t>(bits.to_ulong() & 0b111);
-    return bWord ? Decoder::reg_rm_word[index] : Decoder::reg_rm_byte[index];
+    out << OpcodeToString(decodedInst.opCode) << ' ';
+
+    // Immediate to memory needs the size spelled out.
+    if (decodedInst.DestOT == OperandType::ot_memory && decodedInst.SourceOT == OperandType::ot_immediate)
+    {
+        out << (decodedInst.bWord ? "word " : "byte ");
+    }
+
+    PrintOperand(out, decodedInst, decodedInst.Dest, decodedInst.DestOT);
+
+    if (decodedInst.DestOT != OperandType::ot_jumpTarget && decodedInst.opCode != OpCode::op_undefined)
+    {
+        out << ", ";
+        PrintOperand(out, decodedInst, decodedInst.Source, decodedInst.SourceOT);
+    }
+
+    return out;
 }
 
-static int16_t GetTwoByteImmediateFromInst(uint32_t* binaryInst)
+// reg and r/m fields name a byte register when W = 0: al, cl, dl, bl are the low and ah, ch, dh, bh the high halves of ax, cx, dx, bx.
+static RegisterAccess GetRegister(uint8_t bits, bool bWord)
 {
-    return static_cast<int16_t>( (((*(binaryInst + 1) << 8) | (*(binaryInst) & 0xFF)) & 0xFFFF) );
+    bits &= 0b111;
+
+    if (bWord)
+    {
+        return { static_cast<Register>(bits), 0, 2 };
+    }
+
+    return { static_cast<Register>(bits & 0b11), static_cast<uint8_t>(bits >> 2), 1 };
 }
 
-static std::string GetTwoByteImmediateStrFromInst(uint32_t* binaryInst)
+static int16_t GetTwoByteImmediateFromInst(const uint8_t* binaryInst)
 {
-    return std::to_string(GetTwoByteImmediateFromInst(binaryInst));
+    return static_cast<int16_t>((*(binaryInst + 1) << 8) | *binaryInst);
 }
 
 static void SetRegistersFromMODOneOne(DecodedInstruction& decodedInst, bool bImmediateSource = false)
 {
     if (decodedInst.MOD == 0b11)
     {
-        if (decodedInst.bRegIsDest)
+        if (decodedInst.bRegIsDest && !bImmediateSource)
         {
-            if (!bImmediateSource)
-            {
-                decodedInst.Dest += getRegisterName(decodedInst.Reg, decodedInst.bWord);
-                decodedInst.Source += getRegisterName(decodedInst.RM, decodedInst.bWord);
-                decodedInst.SourceOT = OperandType::ot_memory;
-            }
-            else
-            {
-                decodedInst.Dest += getRegisterName(decodedInst.RM, decodedInst.bWord);
-            }
+            decodedInst.Dest.reg = GetRegister(decodedInst.Reg, decodedInst.bWord);
+            decodedInst.Source.reg = GetRegister(decodedInst.RM, decodedInst.bWord);
         }
         else
         {
-            decodedInst.Dest += getRegisterName(decodedInst.RM, decodedInst.bWord);
+            decodedInst.Dest.reg = GetRegister(decodedInst.RM, decodedInst.bWord);
             if (!bImmediateSource)
             {
-                decodedInst.Source += getRegisterName(decodedInst.Reg, decodedInst.bWord);
+                decodedInst.Source.reg = GetRegister(decodedInst.Reg, decodedInst.bWord);
             }
         }
     }
 }
 
-static std::string GetEffectiveAddressFromMOD(DecodedInstruction& decodedInst)
+static EffectiveAddress GetEffectiveAddressFromMOD(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
 {
     assert(decodedInst.MOD != 0b11);
 
-    const int index = static_cast<int>(decodedInst.RM.to_ulong());
-
-
-    std::string returnVal {'['};
-    Decoder::GetEffectiveAddressIndex(index, returnVal);
-    std::string dispMem{};
-
-    if (decodedInst.MOD.to_ulong() == 0b00)
+    if (Decoder::CheckDispSpecialCon(decodedInst))
     {
-        if (decodedInst.RM.to_ulong() == 0b110)
-        {
-            decodedInst.bDisp = true;
-            decodedInst.memoryIndex = GetTwoByteImmediateFromInst(virtualChip.ip_register + 2);
-            return "[" + std::to_string(decodedInst.memoryIndex) + ']';
-        }
+        decodedInst.bDisp = true;
+        return { Register::reg_none, Register::reg_none, GetTwoByteImmediateFromInst(instructionBytes + 2) };
     }
-    else
+
+    EffectiveAddress address = effectiveAddress[decodedInst.RM];
+
+    if (decodedInst.MOD != 0b00)
     {
         decodedInst.bDisp = true;
 
-        if (decodedInst.MOD.to_ulong() == 0b01)
+        if (decodedInst.MOD == 0b01)
         {
-            decodedInst.memoryIndex += static_cast<int8_t>((*(virtualChip.ip_register + 2) & 0xFF));
+            address.displacement = static_cast<int8_t>(*(instructionBytes + 2));
         }
         else
         {
-            decodedInst.memoryIndex += GetTwoByteImmediateFromInst(virtualChip.ip_register + 2);
-        }
-
-        dispMem = std::to_string(decodedInst.memoryIndex);
-        if (dispMem != "0")
-        {
-            if (dispMem[0] == '-')
-            {
-                dispMem.erase(dispMem.begin());
-                returnVal += " - " + dispMem;
-            }
-            else
-            {
-                returnVal += " + " + dispMem;
-            }
+            address.displacement = GetTwoByteImmediateFromInst(instructionBytes + 2);
         }
     }
 
-    returnVal += "]";
-
-    return returnVal;
+    return address;
 }
 
 // MOD == 00 && RM == 110
@@ -185,21 +244,21 @@ bool Decoder::CheckDispSpecialCon(const DecodedInstruction& decodedInst)
 }
 
 // Register/Memory to/from Register
-static void RegMemToFromReg(DecodedInstruction& decodedInst)
+static void RegMemToFromReg(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
 {
-    decodedInst.bWord = decodedInst.hi[0];
-    decodedInst.bRegIsDest = decodedInst.hi[1];
-    decodedInst.Reg = (decodedInst.lo.to_ulong() >> 3) & 0b111;
-    decodedInst.RM = decodedInst.lo.to_ulong() & 0b111;
-    decodedInst.MOD = decodedInst.lo.to_ulong() >> 6;
+    decodedInst.bWord = decodedInst.hi & 0b1;
+    decodedInst.bRegIsDest = (decodedInst.hi >> 1) & 0b1;
+    decodedInst.Reg = (decodedInst.lo >> 3) & 0b111;
+    decodedInst.RM = decodedInst.lo & 0b111;
+    decodedInst.MOD = decodedInst.lo >> 6;
 
-    if (decodedInst.MOD == std::bitset<2>(0b11))
+    if (decodedInst.MOD == 0b11)
     {
         SetRegistersFromMODOneOne(decodedInst);
     }
     else
     {
-        decodedInst.extraBits += decodedInst.MOD.to_ulong();
+        decodedInst.extraBits += decodedInst.MOD;
 
         if (Decoder::CheckDispSpecialCon(decodedInst))
         {
@@ -209,64 +268,48 @@ static void RegMemToFromReg(DecodedInstruction& decodedInst)
         // Reg is dest?
         if (decodedInst.bRegIsDest)
         {
-            decodedInst.Dest = getRegisterName(decodedInst.Reg, decodedInst.bWord);
-            decodedInst.Source = GetEffectiveAddressFromMOD(decodedInst);
+            decodedInst.Dest.reg = GetRegister(decodedInst.Reg, decodedInst.bWord);
+            decodedInst.Source.address = GetEffectiveAddressFromMOD(decodedInst, instructionBytes);
             decodedInst.SourceOT = OperandType::ot_memory;
         }
         else
         {
-            decodedInst.Dest = GetEffectiveAddressFromMOD(decodedInst);
+            decodedInst.Dest.address = GetEffectiveAddressFromMOD(decodedInst, instructionBytes);
             decodedInst.DestOT = OperandType::ot_memory;
-            decodedInst.Source = getRegisterName(decodedInst.Reg, decodedInst.bWord);
+            decodedInst.Source.reg = GetRegister(decodedInst.Reg, decodedInst.bWord);
         }
     }
 }
 
-static void ImmToRegMem(DecodedInstruction& decodedInst, bool bSWForData = false)
+static void ImmToRegMem(DecodedInstruction& decodedInst, const uint8_t* instructionBytes, bool bSWForData = false)
 {
-    decodedInst.bWord = decodedInst.hi[0];
-    decodedInst.bRegIsDest = decodedInst.hi[1];
-    decodedInst.MOD = decodedInst.lo.to_ulong() >> 6;
-    decodedInst.RM = decodedInst.lo.to_ulong() & 0b111;
-    decodedInst.bSigned = bSWForData ? decodedInst.hi[1] : false;
+    decodedInst.bWord = decodedInst.hi & 0b1;
+    decodedInst.bRegIsDest = (decodedInst.hi >> 1) & 0b1;
+    decodedInst.MOD = decodedInst.lo >> 6;
+    decodedInst.RM = decodedInst.lo & 0b111;
+    decodedInst.bSigned = bSWForData ? decodedInst.bRegIsDest : false;
     decodedInst.SourceOT = OperandType::ot_immediate;
 
-    bool bImmediatePrefix = decodedInst.MOD != 0b11;
-
-    if ((decodedInst.MOD.to_ulong() == 0b10 || Decoder::CheckDispSpecialCon(decodedInst)))
+    if ((decodedInst.MOD == 0b10 || Decoder::CheckDispSpecialCon(decodedInst)))
     {
         decodedInst.extraBits += 2;
     }
-    else if (decodedInst.MOD.to_ulong() == 0b01)
+    else if (decodedInst.MOD == 0b01)
     {
         decodedInst.extraBits += 1;
     }
 
     decodedInst.bDisp = true;
 
-    std::string immediateStr{};
     if (decodedInst.bWord && (!bSWForData || !decodedInst.bSigned))
     {
         decodedInst.extraBits += 2;
-
-        if (bImmediatePrefix)
-        {
-            decodedInst.Dest = "word ";
-        }
-
-        decodedInst.Source += GetTwoByteImmediateStrFromInst(virtualChip.ip_register + decodedInst.extraBits - 1);
+        decodedInst.Source.immediate = GetTwoByteImmediateFromInst(instructionBytes + decodedInst.extraBits - 1);
     }
     else
     {
         decodedInst.extraBits += 1;
-
-        if (bImmediatePrefix)
-        {
-            decodedInst.Dest = "byte ";
-        }
-
-        decodedInst.Source += std::to_string(static_cast<int8_t>(
-            *(virtualChip.ip_register + decodedInst.extraBits) & 0xFF ));
+        decodedInst.Source.immediate = static_cast<int8_t>(*(instructionBytes + decodedInst.extraBits));
     }
 
     if (decodedInst.MOD == 0b11)
@@ -275,269 +318,261 @@ static void ImmToRegMem(DecodedInstruction& decodedInst, bool bSWForData = false
     }
     else
     {
-        decodedInst.Dest += GetEffectiveAddressFromMOD(decodedInst);
+        decodedInst.Dest.address = GetEffectiveAddressFromMOD(decodedInst, instructionBytes);
         decodedInst.DestOT = OperandType::ot_memory;
     }
 
 }
 
-static void ImmToAcc(DecodedInstruction& decodedInst, bool bCanBeWord = true)
+static void ImmToAcc(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
 {
-    decodedInst.bWord = bCanBeWord && decodedInst.hi[0];
+    decodedInst.bWord = decodedInst.hi & 0b1;
+    decodedInst.Dest.reg = GetRegister(0, decodedInst.bWord);
 
     if (decodedInst.bWord)
     {
         ++decodedInst.extraBits;
-        decodedInst.Dest = "ax";
-        decodedInst.Source = GetTwoByteImmediateStrFromInst(virtualChip.ip_register + decodedInst.extraBits - 1);
+        decodedInst.Source.immediate = GetTwoByteImmediateFromInst(instructionBytes + decodedInst.extraBits - 1);
     }
     else
     {
-        decodedInst.Dest = "al";
-        decodedInst.Source = std::to_string(static_cast<int8_t>(*(virtualChip.ip_register + decodedInst.extraBits) & 0xFF));
+        decodedInst.Source.immediate = static_cast<int8_t>(*(instructionBytes + decodedInst.extraBits));
     }
 
     decodedInst.DestOT = OperandType::ot_accumulator;
     decodedInst.SourceOT = OperandType::ot_immediate;
 }
 
-void Decoder::Disasm(DecodedInstruction& decodedInst)
+// 8 bit signed displacement relative to the next instruction.
+static void JumpTarget(DecodedInstruction& decodedInst)
+{
+    decodedInst.destTarget = static_cast<int8_t>(decodedInst.lo);
+    decodedInst.DestOT = OperandType::ot_jumpTarget;
+}
+
+static void MemToAcc(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
+{
+    ++decodedInst.extraBits;
+    decodedInst.bWord = decodedInst.hi & 0b1;
+
+    decodedInst.Dest.reg = GetRegister(0, decodedInst.bWord);
+    decodedInst.DestOT = OperandType::ot_accumulator;
+
+    decodedInst.Source.address.displacement = GetTwoByteImmediateFromInst(instructionBytes + 1);
+    decodedInst.SourceOT = OperandType::ot_memory;
+}
+
+static void AccToMem(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
 {
-    switch (decodedInst.hi.to_ulong())
+    ++decodedInst.extraBits;
+    decodedInst.bWord = decodedInst.hi & 0b1;
+
+    decodedInst.Source.reg = GetRegister(0, decodedInst.bWord);
+    decodedInst.SourceOT = OperandType::ot_accumulator;
+
+    decodedInst.Dest.address.displacement = GetTwoByteImmediateFromInst(instructionBytes + 1);
+    decodedInst.DestOT = OperandType::ot_memory;
+}
+
+static void ImmToReg(DecodedInstruction& decodedInst, const uint8_t* instructionBytes)
+{
+    decodedInst.bWord = (decodedInst.hi >> 3) & 0b1;
+    decodedInst.Reg = decodedInst.hi & 0b111;
+
+    decodedInst.Dest.reg = GetRegister(decodedInst.Reg, decodedInst.bWord);
+    decodedInst.SourceOT = OperandType::ot_immediate;
+
+    if (decodedInst.bWord)
     {
-    case 0b01110100:
-        decodedInst.opCode = OpCode::op_je;
-        break;
-    case 0b01111100:
-        decodedInst.opCode = OpCode::op_jl;
-        break;
-    case 0b01111110:
-        decodedInst.opCode = OpCode::op_jle;
-        break;
-    case 0b01110010:
-        decodedInst.opCode = OpCode::op_jb;
-        break;
-    case 0b01110110:
-        decodedInst.opCode = OpCode::op_jbe;
-        break;
-    case 0b01111010:
-        decodedInst.opCode = OpCode::op_jp;
-        break;
-    case 0b01110000:
-        decodedInst.opCode = OpCode::op_jo;
-        break;
-    case 0b01111000:
-        decodedInst.opCode = OpCode::op_js;
-        break;
-    case 0b01110101:
-        decodedInst.opCode = OpCode::op_jne;
-        break;
-    case 0b01111101:
-        decodedInst.opCode = OpCode::op_jnl;
-        break;
-    case 0b01111111:
-        decodedInst.opCode = OpCode::op_jnle;
-        break;
-    case 0b01110011:
-        decodedInst.opCode = OpCode::op_jnb;
-        break;
-    case 0b01110111:
-        decodedInst.opCode = OpCode::op_jnbe;
-        break;
-    case 0b01111011:
-        decodedInst.opCode = OpCode::op_jnp;
-        break;
-    case 0b01110001:
-        decodedInst.opCode = OpCode::op_jno;
-        break;
-    case 0b01111001:
-        decodedInst.opCode = OpCode::op_jns;
-        break;
-    case 0b11100010:
-        decodedInst.opCode = OpCode::op_loop;
-        break;
-    case 0b11100001:
-        decodedInst.opCode = OpCode::op_loopz;
-        break;
-    case 0b11100000:
-        decodedInst.opCode = OpCode::op_loopnz;
-        break;
-    case 0b11100011:
-        decodedInst.opCode = OpCode::op_jcxz;
-        break;
-    default:
-        break;
+        ++decodedInst.extraBits;
+        decodedInst.Source.immediate = GetTwoByteImmediateFromInst(instructionBytes + 1);
     }
-
-    if (decodedInst.opCode != OpCode::op_undefined)
+    else
     {
-        decodedInst.destTarget = static_cast<int8_t>(*(virtualChip.ip_register + 1) & 0xFF);
-        decodedInst.DestOT = OperandType::ot_jumpTarget;
+        decodedInst.Source.immediate = static_cast<int8_t>(decodedInst.lo);
+    }
+}
 
-        decodedInst.Dest = "$";
-        if (decodedInst.destTarget >= 0)
-        {
-            decodedInst.Dest += "+";
-        }
-        decodedInst.Dest += std::to_string(decodedInst.destTarget + 2);
+// How the bytes following the first one are laid out. Each layout knows its own length rules.
+enum class InstructionLayout : uint8_t
+{
+    il_none,
+    il_jump,            // disp8
+    il_regMemToFromReg, // d w | mod reg r/m | (disp-lo) | (disp-hi)
+    il_immToRegMem,     // w | mod ### r/m | (disp-lo) | (disp-hi) | data | (data if w = 1)
+    il_immToRegMemSW,   // s w | mod ### r/m | (disp-lo) | (disp-hi) | data | (data if s:w = 01)
+    il_immToAcc,        // w | data | (data if w = 1)
+    il_memToAcc,        // w | addr-lo | addr-hi
+    il_accToMem,        // w | addr-lo | addr-hi
+    il_immToReg,        // w reg | data | (data if w = 1)
+    il_group            // opcode is selected by the reg field of the second byte
+};
+
+enum class InstructionGroup : uint8_t
+{
+    ig_none,
+    ig_immediate, // 100000sw
+    ig_unary,     // 1111011w
+    ig_count
+};
 
-        return;
+struct InstructionFormat
+{
+    OpCode opCode = OpCode::op_undefined;
+    InstructionLayout layout = InstructionLayout::il_none;
+    InstructionGroup group = InstructionGroup::ig_none;
+};
+
+// First byte bit pattern, the bits of it that identify the instruction and what it decodes to.
+struct EncodingSpec
+{
+    uint8_t bits;
+    uint8_t mask;
+    InstructionFormat format;
+};
+
+static constexpr EncodingSpec encodingSpec[]
+{
+    { 0b10001000, 0b11111100, { OpCode::op_mov, InstructionLayout::il_regMemToFromReg } },
+    { 0b11000110, 0b11111110, { OpCode::op_mov, InstructionLayout::il_immToRegMem } },
+    { 0b10110000, 0b11110000, { OpCode::op_mov, InstructionLayout::il_immToReg } },
+    { 0b10100000, 0b11111110, { OpCode::op_mov, InstructionLayout::il_memToAcc } },
+    { 0b10100010, 0b11111110, { OpCode::op_mov, InstructionLayout::il_accToMem } },
+
+    { 0b00000000, 0b11111100, { OpCode::op_add, InstructionLayout::il_regMemToFromReg } },
+    { 0b00000100, 0b11111110, { OpCode::op_add, InstructionLayout::il_immToAcc } },
+
+    { 0b00101000, 0b11111100, { OpCode::op_sub, InstructionLayout::il_regMemToFromReg } },
+    { 0b00101100, 0b11111110, { OpCode::op_sub, InstructionLayout::il_immToAcc } },
+
+    { 0b00111000, 0b11111100, { OpCode::op_cmp, InstructionLayout::il_regMemToFromReg } },
+    { 0b00111100, 0b11111110, { OpCode::op_cmp, InstructionLayout::il_immToAcc } },
+
+    { 0b10000100, 0b11111110, { OpCode::op_test, InstructionLayout::il_regMemToFromReg } },
+    { 0b10101000, 0b11111110, { OpCode::op_test, InstructionLayout::il_immToAcc } },
+
+    { 0b10000000, 0b11111100, { OpCode::op_undefined, InstructionLayout::il_group, InstructionGroup::ig_immediate } },
+    { 0b11110110, 0b11111110, { OpCode::op_undefined, InstructionLayout::il_group, InstructionGroup::ig_unary } },
+
+    { 0b01110100, 0b11111111, { OpCode::op_je, InstructionLayout::il_jump } },
+    { 0b01111100, 0b11111111, { OpCode::op_jl, InstructionLayout::il_jump } },
+    { 0b01111110, 0b11111111, { OpCode::op_jle, InstructionLayout::il_jump } },
+    { 0b01110010, 0b11111111, { OpCode::op_jb, InstructionLayout::il_jump } },
+    { 0b01110110, 0b11111111, { OpCode::op_jbe, InstructionLayout::il_jump } },
+    { 0b01111010, 0b11111111, { OpCode::op_jp, InstructionLayout::il_jump } },
+    { 0b01110000, 0b11111111, { OpCode::op_jo, InstructionLayout::il_jump } },
+    { 0b01111000, 0b11111111, { OpCode::op_js, InstructionLayout::il_jump } },
+    { 0b01110101, 0b11111111, { OpCode::op_jne, InstructionLayout::il_jump } },
+    { 0b01111101, 0b11111111, { OpCode::op_jnl, InstructionLayout::il_jump } },
+    { 0b01111111, 0b11111111, { OpCode::op_jnle, InstructionLayout::il_jump } },
+    { 0b01110011, 0b11111111, { OpCode::op_jnb, InstructionLayout::il_jump } },
+    { 0b01110111, 0b11111111, { OpCode::op_jnbe, InstructionLayout::il_jump } },
+    { 0b01111011, 0b11111111, { OpCode::op_jnp, InstructionLayout::il_jump } },
+    { 0b01110001, 0b11111111, { OpCode::op_jno, InstructionLayout::il_jump } },
+    { 0b01111001, 0b11111111, { OpCode::op_jns, InstructionLayout::il_jump } },
+    { 0b11100010, 0b11111111, { OpCode::op_loop, InstructionLayout::il_jump } },
+    { 0b11100001, 0b11111111, { OpCode::op_loopz, InstructionLayout::il_jump } },
+    { 0b11100000, 0b11111111, { OpCode::op_loopnz, InstructionLayout::il_jump } },
+    { 0b11100011, 0b11111111, { OpCode::op_jcxz, InstructionLayout::il_jump } },
+};
+
+// Indexed by the reg field of the second byte.
+static constexpr InstructionFormat groupSpec[static_cast<size_t>(InstructionGroup::ig_count)][8]
+{
+    // ig_none
+    {},
+
+    // ig_immediate
+    {
+        { OpCode::op_add, InstructionLayout::il_immToRegMemSW }, {}, {}, {}, {},
+        { OpCode::op_sub, InstructionLayout::il_immToRegMemSW }, {},
+        { OpCode::op_cmp, InstructionLayout::il_immToRegMemSW }
+    },
+
+    // ig_unary
+    {
+        { OpCode::op_test, InstructionLayout::il_immToRegMem }
     }
+};
 
-    switch (decodedInst.hi.to_ulong() >> 1)
+static constexpr std::array<InstructionFormat, 256> BuildFormatTable()
+{
+    std::array<InstructionFormat, 256> table{};
+
+    for (const EncodingSpec& spec : encodingSpec)
     {
-    // mov immediate to reg/mem
-    case 0b1100011:
-        decodedInst.opCode = OpCode::op_mov;
-        ImmToRegMem(decodedInst);
-        return;
+        for (size_t i{ 0 }; i < table.size(); ++i)
+        {
+            if ((i & spec.mask) == spec.bits)
+            {
+                table[i] = spec.format;
+            }
+        }
+    }
 
-    // mov mem to acc
-    case 0b1010000:
-        ++decodedInst.extraBits;
-        decodedInst.bWord = decodedInst.hi[0];
+    return table;
+}
 
-        decodedInst.opCode = OpCode::op_mov;
-        decodedInst.Dest = (decodedInst.bWord ? "ax" : "al");
-        decodedInst.DestOT = OperandType::ot_accumulator;
+static constexpr std::array<InstructionFormat, 256> formatTable = BuildFormatTable();
 
-        decodedInst.Source = '[' + GetTwoByteImmediateStrFromInst(virtualChip.ip_register + 1) + ']';
-        decodedInst.SourceOT = OperandType::ot_memory;
-        return;
+void Decoder::Disasm(const VirtualChip& chip, uint32_t ip, DecodedInstruction& decodedInst)
+{
+    assert(chip.m_program);
 
-     // mov acc to mem
-    case 0b1010001:
-        ++decodedInst.extraBits;
+    Disasm(chip.m_program, ip, decodedInst);
+}
 
-        decodedInst.opCode = OpCode::op_mov;
+void Decoder::Disasm(const uint8_t* program, uint32_t ip, DecodedInstruction& decodedInst)
+{
+    const uint8_t* instructionBytes = program + ip;
+    decodedInst.hi = instructionBytes[0];
+    decodedInst.lo = instructionBytes[1];
 
-        decodedInst.Source = (decodedInst.hi[0] ? "ax" : "al");
-        decodedInst.SourceOT = OperandType::ot_accumulator;
+    InstructionFormat format = formatTable[decodedInst.hi];
 
-        decodedInst.Dest = '[' + GetTwoByteImmediateStrFromInst(virtualChip.ip_register + 1) + ']';
-        decodedInst.DestOT = OperandType::ot_memory;
-        return;
+    if (format.layout == InstructionLayout::il_group)
+    {
+        format = groupSpec[static_cast<size_t>(format.group)][(decodedInst.lo >> 3) & 0b111];
+    }
 
-    // add immediate to acc
-    case 0b0000010:
-        decodedInst.opCode = OpCode::op_add;
-        ImmToAcc(decodedInst);
-        return;
+    decodedInst.opCode = format.opCode;
 
-    // sub immediate to acc
-    case 0b0010110:
-        decodedInst.opCode = OpCode::op_sub;
-        ImmToAcc(decodedInst);
+    switch (format.layout)
+    {
+    case InstructionLayout::il_jump:
+        JumpTarget(decodedInst);
         return;
 
-    // cmp immediate to acc
-    case 0b0011110:
-        decodedInst.opCode = OpCode::op_cmp;
-        ImmToAcc(decodedInst);
+    case InstructionLayout::il_regMemToFromReg:
+        RegMemToFromReg(decodedInst, instructionBytes);
         return;
 
-    // test immediate and reg/mem
-    case 0b1111011:
-        decodedInst.opCode = OpCode::op_test;
-        ImmToRegMem(decodedInst);
+    case InstructionLayout::il_immToRegMem:
+        ImmToRegMem(decodedInst, instructionBytes);
         return;
-    // test immediate and acc
-    case 0b1010100:
-        decodedInst.opCode = OpCode::op_test;
-        ImmToAcc(decodedInst, false);
-        return;
-    default:
-        break;
-    }
 
-    switch (decodedInst.hi.to_ulong() >> 2)
-    {
-    // mov reg/mem to/from reg
-    case 0b100010:
-        decodedInst.opCode = OpCode::op_mov;
-        RegMemToFromReg(decodedInst);
+    case InstructionLayout::il_immToRegMemSW:
+        ImmToRegMem(decodedInst, instructionBytes, true);
         return;
 
-    // add reg/mem with reg to either
-    case 0b000000:
-        decodedInst.opCode = OpCode::op_add;
-        RegMemToFromReg(decodedInst);
+    case InstructionLayout::il_immToAcc:
+        ImmToAcc(decodedInst, instructionBytes);
         return;
 
-    // sub reg/mem with reg to either
-    case 0b001010:
-        decodedInst.opCode = OpCode::op_sub;
-        RegMemToFromReg(decodedInst);
-        return;
-    
-    // cmp reg/mem with reg to either
-    case 0b001110:  
-        decodedInst.opCode = OpCode::op_cmp;
-        RegMemToFromReg(decodedInst);
+    case InstructionLayout::il_memToAcc:
+        MemToAcc(decodedInst, instructionBytes);
         return;
 
-    case 0b100000:
-        switch ((decodedInst.lo.to_ulong() >> 3) & 0b111)
-        {
-        // add immediate to reg/mem
-        case 0b000:
-            decodedInst.opCode = OpCode::op_add;
-            ImmToRegMem(decodedInst, true);
-            return;
-
-        // sub immediate to reg/mem
-        case 0b101:
-            decodedInst.opCode = OpCode::op_sub;
-            ImmToRegMem(decodedInst, true);
-            return;
-
-        // cmp immediate to reg/mem
-        case 0b111:
-            decodedInst.opCode = OpCode::op_cmp;
-            ImmToRegMem(decodedInst, true);
-            return;
-
-        default:
-            std::cout << "Undefined register!\n";
-            return;
-        }
-        
+    case InstructionLayout::il_accToMem:
+        AccToMem(decodedInst, instructionBytes);
         return;
 
-    // test reg/mem with reg to either
-    case 0b000100:
-        decodedInst.opCode = OpCode::op_test;
-        RegMemToFromReg(decodedInst);
+    case InstructionLayout::il_immToReg:
+        ImmToReg(decodedInst, instructionBytes);
         return;
 
     default:
+        // Left as op_undefined, two bytes long as extraBits keeps its default of 1.
         break;
     }
-
-    // mov immediate to reg
-    if (decodedInst.hi >> 4 == 0b1011)
-    {
-        decodedInst.bWord = decodedInst.hi[3];
-        decodedInst.Reg = decodedInst.hi.to_ulong() & 0b111;
-
-        decodedInst.opCode = OpCode::op_mov;
-        decodedInst.Dest = getRegisterName(decodedInst.Reg, decodedInst.bWord);
-
-        decodedInst.SourceOT = OperandType::ot_immediate;
-
-        if (decodedInst.bWord)
-        {
-            ++decodedInst.extraBits;
-            decodedInst.Source = GetTwoByteImmediateStrFromInst(virtualChip.ip_register + 1);
-        }
-        else
-        {
-            decodedInst.Source = std::to_string(static_cast<int16_t>(
-                *(virtualChip.ip_register + 1) & 0xFFFF));
-        }
-
-        return;
-    }
-
-    std::cout << "Undefined register!\n";
-}
\ No newline at end of file
+}
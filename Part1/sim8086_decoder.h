@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cstddef>
 #include <vector>
 #include <string>
 #include <bitset>
 #include <memory>
 #include <unordered_map>
 
+#include "sim8086_estimation.h"
+
 struct DecodedInstruction;
+struct EffectiveAddress;
+struct VirtualChip;
 
 enum class ExecutionType : uint8_t
 {
@@ -20,11 +25,14 @@ enum class ExecutionType : uint8_t
 
 namespace Decoder
 {
-	void Disasm(DecodedInstruction& binaryInstruction);
+	// Decodes the instruction at ip in chip's program.
+	void Disasm(const VirtualChip& chip, uint32_t ip, DecodedInstruction& binaryInstruction);
 
-	size_t FindWordIndex(const std::string& in, bool bWord);
+	// The same for a program that isn't loaded into a chip, padded like ProgramImage.
+	void Disasm(const uint8_t* program, uint32_t ip, DecodedInstruction& binaryInstruction);
 
-	uint32_t GetEffectiveAddressIndex(int index, std::string& Address);
+	// Resolves base + index + displacement against chip's register values, wraps at 64K like the 8086 does.
+	uint32_t GetEffectiveAddressIndex(const VirtualChip& chip, const EffectiveAddress& address);
 
 	bool CheckDispSpecialCon(const DecodedInstruction& decodedInst);
 
@@ -32,11 +40,6 @@ namespace Decoder
 	const std::vector<std::string> reg_rm_byte{ "al", "cl", "dl", "bl", "ah", "ch", "dh", "bh" };
 	// W = 1
 	const std::vector<std::string> reg_rm_word{ "ax", "cx", "dx", "bx", "sp", "bp", "si", "di" };
-
-	// index <= 3 == baseReg + indexReg, index > 3 && index < 6 == indexReg, else == baseReg 
-	const std::vector<std::string> effectiveAdress{ "bx + si", "bx + di", "bp + si", "bp + di", "si", "di", "bp", "bx" };
-
-	static ExecutionType executionType{};
 }
 
 #define OPCODE_LIST \
@@ -87,26 +90,63 @@ enum class OperandType
 	ot_jumpTarget
 };
 
-struct DecodedInstruction
+// Same order as the reg field encodes them when W = 1.
+enum class Register : uint8_t
+{
+	reg_ax,
+	reg_cx,
+	reg_dx,
+	reg_bx,
+	reg_sp,
+	reg_bp,
+	reg_si,
+	reg_di,
+	reg_none
+};
+
+struct RegisterAccess
 {
-	DecodedInstruction();
+	Register index = Register::reg_none;
+	// 1 == high byte of index
+	uint8_t offset = 0;
+	// 1 == byte, 2 == word
+	uint8_t count = 2;
+};
+
+struct EffectiveAddress
+{
+	Register base = Register::reg_none;
+	Register index = Register::reg_none;
+	int16_t displacement = 0;
+};
+
+// Which member is meaningful depends on the operand's OperandType.
+struct Operand
+{
+	RegisterAccess reg{};
+	EffectiveAddress address{};
+	int16_t immediate = 0;
+};
 
+struct DecodedInstruction
+{
 	friend std::ostream& operator<<(std::ostream& out, const DecodedInstruction& decodedInst);
 
-	std::string Dest{};
-	std::string Source{};
+	Operand Dest{};
+	Operand Source{};
 
-	std::bitset<8> hi{};
-	std::bitset<8> lo{};
+	uint8_t hi{};
+	uint8_t lo{};
 
-	std::bitset<3> Reg{};
-	std::bitset<3> RM{};
-	std::bitset<2> MOD{};
+	uint8_t Reg{};
+	uint8_t RM{};
+	uint8_t MOD{};
 
 	OpCode opCode = OpCode::op_undefined;
 	OperandType DestOT = OperandType::ot_register;
 	OperandType SourceOT = OperandType::ot_register;
 
+	// Resolved from the memory operand's effective address when the instruction executes.
 	size_t memoryIndex = 0;
 	size_t extraBits = 1;
 	int8_t destTarget = 0;
@@ -122,7 +162,85 @@ struct DecodedInstruction
 	bool bPrintFlags = false;
 };
 
-struct VirtualChip
+// Decoded instructions by ip offset. Decoding reads nothing but program bytes, so an entry stays valid
+// until the program it was decoded from is replaced, which is what Reset is for.
+class DecodeCache
+{
+public:
+	void Reset(size_t programSize);
+
+	// Instruction at chip.ip_register, decoded on first use.
+	const DecodedInstruction& Fetch(const VirtualChip& chip);
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+private:
+	// 0 == not decoded yet, else index + 1 into m_entries.
+	std::vector<uint32_t> m_slots{};
+	std::vector<DecodedInstruction> m_entries{};
+};
+
+// What the arithmetic flags of the last add, sub or cmp are derived from.
+struct LazyFlags
+{
+	OpCode opCode = OpCode::op_undefined;
+	uint16_t newVal = 0;
+	uint16_t oldDestVal = 0;
+	uint16_t sourceVal = 0;
+};
+
+// ax..di, and which of them have been written in the order they first were.
+struct RegisterFile
+{
+	inline uint16_t& operator[](size_t index)
+	{
+		return words[index];
+	}
+
+	inline uint16_t operator[](size_t index) const
+	{
+		return words[index];
+	}
+
+	// al..bh as the decoder gives them, the low or high byte of a word register.
+	inline uint8_t& Byte(const RegisterAccess& reg)
+	{
+		return reinterpret_cast<uint8_t*>(words)[static_cast<size_t>(reg.index) * 2 + reg.offset];
+	}
+
+	inline void AddMutated(size_t reg)
+	{
+		const uint8_t bit = static_cast<uint8_t>(1u << reg);
+		if (!(mutatedBits & bit))
+		{
+			mutatedBits |= bit;
+			mutated[mutatedCount++] = static_cast<uint8_t>(reg);
+		}
+	}
+
+	// Forgets all but the first count registers written.
+	inline void TruncateMutated(uint8_t count)
+	{
+		while (mutatedCount > count)
+		{
+			mutatedBits &= static_cast<uint8_t>(~(1u << mutated[--mutatedCount]));
+		}
+	}
+
+	// Little endian like the 8086, so the high byte of words[i] is byte i * 2 + 1.
+	uint16_t words[8]{};
+	uint8_t mutated[8]{};
+	uint8_t mutatedCount = 0;
+	// Bit i set once register i is in mutated.
+	uint8_t mutatedBits = 0;
+};
+
+// Everything one simulation works on. Nothing else holds simulation state, so any number of them can
+// run side by side as long as each is used by one thread at a time.
+// What every instruction reads or writes comes first. Up to m_program it fits in the first cache line, there's
+// no room left for m_programSize, which starts the second.
+struct alignas(64) VirtualChip
 {
 	inline uint16_t& operator[](size_t index)
 	{
@@ -134,18 +252,47 @@ struct VirtualChip
 		return m_registers[static_cast<size_t>(index)];
 	}
 
-	void AddUniqueMutatedRegister(size_t newReg);
+	inline void AddUniqueMutatedRegister(size_t newReg)
+	{
+		m_registers.AddMutated(newReg);
+	}
 
-	uint32_t* ip_register = nullptr;
+	// Every write to m_memory goes through here, so a ChipSnapshot knows which pages to put back.
+	inline void MarkDirty(size_t index, size_t size)
+	{
+		m_dirtyPages[index >> pageShift] = 1;
+		m_dirtyPages[(index + size - 1) >> pageShift] = 1;
+	}
 
-	std::vector<uint8_t> m_memory{ std::vector<uint8_t>(1048576) };
-	std::vector<uint16_t> m_registers{ std::vector<uint16_t>(8) };
+	static constexpr size_t memorySize = 1048576;
+	static constexpr size_t pageShift = 12;
+	static constexpr size_t pageCount = memorySize >> pageShift;
+
+	RegisterFile m_registers{};
+
+	// Bus the clocks are estimated for. In the padding m_registers leaves in front of ip_register.
+	Estimator::CpuTarget cpuTarget = Estimator::CpuTarget::i8086;
+
+	// Byte offset of the next instruction in m_program.
+	uint32_t ip_register = 0;
+
+	// Read through Simulator::GetFlag and GetFlags, m_lazyFlags may hold newer arithmetic flags than these.
 	std::bitset<16> m_flags{};
-	std::vector<char> m_flagSymbols{ 'C', {}, 'P', {}, 'A', {}, 'Z', 'S', 'T', 'I', 'D', 'O' };
+	// op_undefined once m_flags is current.
+	LazyFlags m_lazyFlags{};
+
+	int64_t totalClocks = 0;
+
+	// Decoded from at every ip.
+	const uint8_t* m_program = nullptr;
+	size_t m_programSize = 0;
 
-	std::vector<size_t> m_mutatedRegisters{};
+	static constexpr char flagSymbols[]{ 'C', 0, 'P', 0, 'A', 0, 'Z', 'S', 'T', 'I', 'D', 'O' };
 
-	int32_t totalClocks = 0;
+	std::vector<uint8_t> m_memory{ std::vector<uint8_t>(memorySize) };
+	// 1 for every page of m_memory written since the last ChipSnapshot::Capture or Restore.
+	std::vector<uint8_t> m_dirtyPages{ std::vector<uint8_t>(pageCount) };
 };
 
-inline VirtualChip virtualChip {};
\ No newline at end of file
+static_assert(offsetof(VirtualChip, cpuTarget) + sizeof(Estimator::CpuTarget) <= 64);
+static_assert(offsetof(VirtualChip, m_program) + sizeof(const uint8_t*) <= 64);
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+#include "sim8086_decoder.h"
+#include "sim8086_dump.h"
+#include "sim8086_loader.h"
+
+static_assert(MemoryDumper::pageSize == size_t{ 1 } << VirtualChip::pageShift);
+
+// PackBits, see SparseDumpHeader.
+static void Compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t run = 1;
+		while (i + run < size && run < 129 && data[i + run] == data[i])
+		{
+			++run;
+		}
+
+		if (run >= 3)
+		{
+			out.push_back(static_cast<uint8_t>(run + 125));
+			out.push_back(data[i]);
+			i += run;
+			continue;
+		}
+
+		// Literals up to the next run of at least three, shorter runs don't fit the repeat encoding.
+		size_t literals = 1;
+		while (i + literals < size && literals < 128 &&
+			!(i + literals + 2 < size && data[i + literals] == data[i + literals + 1] && data[i + literals] == data[i + literals + 2]))
+		{
+			++literals;
+		}
+
+		out.push_back(static_cast<uint8_t>(literals - 1));
+		out.insert(out.end(), data + i, data + i + literals);
+		i += literals;
+	}
+}
+
+// Undoes Compress, false unless data decodes to exactly size bytes.
+static bool Decompress(const uint8_t* data, size_t dataSize, uint8_t* out, size_t size)
+{
+	size_t i = 0;
+	size_t written = 0;
+	while (i < dataSize)
+	{
+		const uint8_t control = data[i++];
+		if (control < 128)
+		{
+			const size_t literals = control + size_t{ 1 };
+			if (i + literals > dataSize || written + literals > size)
+			{
+				return false;
+			}
+
+			std::memcpy(out + written, data + i, literals);
+			i += literals;
+			written += literals;
+		}
+		else
+		{
+			const size_t run = control - size_t{ 125 };
+			if (i == dataSize || written + run > size)
+			{
+				return false;
+			}
+
+			std::memset(out + written, data[i++], run);
+			written += run;
+		}
+	}
+
+	return written == size;
+}
+
+MemoryDumper::MemoryDumper(DumpFormat format)
+	: m_format(format)
+{
+	m_worker = std::thread(&MemoryDumper::Work, this);
+}
+
+MemoryDumper::~MemoryDumper()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStopping = true;
+	}
+
+	m_changed.notify_all();
+	m_worker.join();
+}
+
+void MemoryDumper::Submit(const VirtualChip& chip)
+{
+	// The copy and the file name probe don't need the worker, it only waits on the lock for the queue.
+	PendingDump dump{ NextFilePath() };
+	if (m_format == DumpFormat::raw)
+	{
+		dump.memory = chip.m_memory;
+	}
+	else
+	{
+		for (uint32_t page{ 0 }; page < VirtualChip::pageCount; ++page)
+		{
+			if (chip.m_dirtyPages[page])
+			{
+				const auto start = chip.m_memory.begin() + static_cast<std::ptrdiff_t>(page * pageSize);
+				dump.memory.insert(dump.memory.end(), start, start + pageSize);
+				dump.pages.push_back(page);
+			}
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [this] { return m_pending.size() < maxPending; });
+
+	m_pending.push_back(std::move(dump));
+
+	lock.unlock();
+	m_changed.notify_all();
+}
+
+void MemoryDumper::Finish()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [this] { return m_pending.empty() && !m_bWriting; });
+}
+
+void MemoryDumper::Work()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		m_changed.wait(lock, [this] { return !m_pending.empty() || m_bStopping; });
+
+		if (m_pending.empty())
+		{
+			return;
+		}
+
+		const PendingDump dump = std::move(m_pending.front());
+		m_pending.pop_front();
+		m_bWriting = true;
+
+		lock.unlock();
+		m_changed.notify_all();
+
+		Write(dump);
+
+		lock.lock();
+		m_bWriting = false;
+		m_changed.notify_all();
+	}
+}
+
+void MemoryDumper::Write(const PendingDump& dump) const
+{
+	std::ofstream file(dump.filePath, std::ios::binary);
+
+	if (m_format == DumpFormat::raw)
+	{
+		file.write(reinterpret_cast<const char*>(dump.memory.data()), static_cast<std::streamsize>(dump.memory.size()));
+		return;
+	}
+
+	SparseDumpHeader header{};
+	header.pageSize = pageSize;
+	header.memorySize = static_cast<uint32_t>(VirtualChip::memorySize);
+	header.bCompressed = m_format == DumpFormat::compressed;
+
+	std::vector<uint8_t> body{};
+	std::vector<uint8_t> compressed{};
+
+	for (size_t i{ 0 }; i < dump.pages.size(); ++i)
+	{
+		const uint8_t* page = dump.memory.data() + i * pageSize;
+
+		// Written to, but maybe only with zeros.
+		if (std::all_of(page, page + pageSize, [](uint8_t byte) { return byte == 0; }))
+		{
+			continue;
+		}
+
+		const uint8_t* stored = page;
+		size_t storedSize = pageSize;
+
+		if (header.bCompressed)
+		{
+			compressed.clear();
+			Compress(page, pageSize, compressed);
+			stored = compressed.data();
+			storedSize = compressed.size();
+		}
+
+		SparseDumpPage pageHeader{ dump.pages[i], static_cast<uint32_t>(storedSize) };
+		body.insert(body.end(), reinterpret_cast<const uint8_t*>(&pageHeader), reinterpret_cast<const uint8_t*>(&pageHeader + 1));
+		body.insert(body.end(), stored, stored + storedSize);
+
+		++header.pageCount;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+}
+
+// Looks for the first free name once, later dumps of the same run just take the next number. Only Submit calls it,
+// so m_nextIndex is never touched by the worker.
+std::string MemoryDumper::NextFilePath()
+{
+	const char* extension = m_format == DumpFormat::raw ? ".data" : ".sparse";
+
+	std::string filePath = "sim8086_memory_" + std::to_string(m_nextIndex) + extension;
+	while (std::filesystem::exists(filePath))
+	{
+		++m_nextIndex;
+		filePath = "sim8086_memory_" + std::to_string(m_nextIndex) + extension;
+	}
+
+	++m_nextIndex;
+
+	return filePath;
+}
+
+bool ReadMemoryDump(const char* filePath, std::vector<uint8_t>& memory)
+{
+	ProgramImage image{};
+	if (!image.Open(filePath))
+	{
+		return false;
+	}
+
+	SparseDumpHeader header{};
+	if (image.Size() < sizeof(header) || std::memcmp(image.Data(), header.magic, sizeof(header.magic)) != 0)
+	{
+		// Raw dumps are just the memory.
+		if (image.Size() != VirtualChip::memorySize)
+		{
+			return false;
+		}
+
+		memory.assign(image.Data(), image.Data() + image.Size());
+		return true;
+	}
+
+	std::memcpy(&header, image.Data(), sizeof(header));
+	if (header.pageSize == 0 || header.memorySize != VirtualChip::memorySize)
+	{
+		return false;
+	}
+
+	memory.assign(header.memorySize, 0);
+
+	size_t offset = sizeof(header);
+	for (uint32_t i{ 0 }; i < header.pageCount; ++i)
+	{
+		SparseDumpPage pageHeader{};
+		if (image.Size() - offset < sizeof(pageHeader))
+		{
+			return false;
+		}
+
+		std::memcpy(&pageHeader, image.Data() + offset, sizeof(pageHeader));
+		offset += sizeof(pageHeader);
+
+		const size_t pageStart = static_cast<size_t>(pageHeader.pageIndex) * header.pageSize;
+		if (image.Size() - offset < pageHeader.storedSize || pageStart >= memory.size())
+		{
+			return false;
+		}
+
+		const uint8_t* stored = image.Data() + offset;
+		const size_t size = std::min<size_t>(header.pageSize, memory.size() - pageStart);
+		offset += pageHeader.storedSize;
+
+		if (header.bCompressed)
+		{
+			if (!Decompress(stored, pageHeader.storedSize, memory.data() + pageStart, size))
+			{
+				return false;
+			}
+		}
+		else if (pageHeader.storedSize == size)
+		{
+			std::memcpy(memory.data() + pageStart, stored, size);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return offset == image.Size();
+}
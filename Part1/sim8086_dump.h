@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct VirtualChip;
+
+enum class DumpFormat : uint8_t
+{
+	// The whole 1 MiB as is, sim8086_memory_N.data.
+	raw,
+	// Only pages holding something other than zeros, sim8086_memory_N.sparse.
+	sparse,
+	// sparse with every page run length encoded.
+	compressed
+};
+
+// Layout of .sparse dumps: SparseDumpHeader, then pageCount times a SparseDumpPage followed by storedSize bytes.
+// Compressed pages are PackBits encoded: a control byte c < 128 is followed by c + 1 literal bytes, c >= 128
+// by one byte that repeats c - 125 times. Pages that aren't stored are all zeros.
+struct SparseDumpHeader
+{
+	char magic[8]{ 'S', '8', '6', 'D', 'U', 'M', 'P', '1' };
+	uint32_t pageSize = 0;
+	uint32_t pageCount = 0;
+	uint32_t memorySize = 0;
+	uint8_t bCompressed = 0;
+	uint8_t reserved[3]{};
+};
+
+struct SparseDumpPage
+{
+	uint32_t pageIndex = 0;
+	uint32_t storedSize = 0;
+};
+
+// Writes memory dumps on a background thread, so the simulation only pays for copying memory.
+// Each dump goes to the next free sim8086_memory_N file in the working directory.
+// Sparse dumps only copy and look at the pages VirtualChip::m_dirtyPages marks, the others are taken to be zeros. That
+// holds for a chip that started from zeroed memory and only restored snapshots captured before it wrote any, like
+// sim8086's.
+class MemoryDumper
+{
+public:
+	explicit MemoryDumper(DumpFormat format);
+	~MemoryDumper();
+
+	MemoryDumper(const MemoryDumper&) = delete;
+	MemoryDumper& operator=(const MemoryDumper&) = delete;
+
+	// Queues a copy of chip's memory. Blocks while maxPending dumps are still waiting for the disk. Call it from one thread.
+	void Submit(const VirtualChip& chip);
+
+	// Waits for every queued dump to be written.
+	void Finish();
+
+	static constexpr uint32_t pageSize = 4096;
+	static constexpr size_t maxPending = 8;
+
+private:
+	struct PendingDump
+	{
+		std::string filePath{};
+		// All of memory for raw dumps, the pages in pages one after the other for sparse ones.
+		std::vector<uint8_t> memory{};
+		std::vector<uint32_t> pages{};
+	};
+
+	void Work();
+	void Write(const PendingDump& dump) const;
+	std::string NextFilePath();
+
+	DumpFormat m_format = DumpFormat::raw;
+	uint32_t m_nextIndex = 0;
+
+	std::mutex m_mutex{};
+	std::condition_variable m_changed{};
+	std::deque<PendingDump> m_pending{};
+	bool m_bWriting = false;
+	bool m_bStopping = false;
+
+	std::thread m_worker{};
+};
+
+// Reads a dump of any DumpFormat back into memory, which ends up VirtualChip::memorySize bytes. False when filePath
+// can't be read or isn't a dump.
+bool ReadMemoryDump(const char* filePath, std::vector<uint8_t>& memory);
@@ -8,7 +8,7 @@ static int8_t EA(const DecodedInstruction& decodedInst)
 		return 0;
 	}
 
-	const uint8_t RM = static_cast<uint8_t>(decodedInst.RM.to_ulong());
+	const uint8_t RM = decodedInst.RM;
 
 	if (Decoder::CheckDispSpecialCon(decodedInst))
 	{
@@ -20,7 +20,9 @@ static int8_t EA(const DecodedInstruction& decodedInst)
 		return 0;
 	}
 
-	if (decodedInst.bDisp && decodedInst.memoryIndex > 0)
+	const Operand& memoryOperand = decodedInst.DestOT == OperandType::ot_memory ? decodedInst.Dest : decodedInst.Source;
+
+	if (decodedInst.bDisp && memoryOperand.address.displacement != 0)
 	{
 		if (RM <= 3)
 		{
@@ -53,9 +55,10 @@ static int8_t EA(const DecodedInstruction& decodedInst)
 	}
 }
 
-static void Estimator::EstimateClocks(const DecodedInstruction& decodedInst, int32_t& estimatedClocks, int32_t& ea)
+void Estimator::EstimateClocks(const DecodedInstruction& decodedInst, int32_t& estimatedClocks, int32_t& ea, bool bBranchTaken)
 {
 	ea = EA(decodedInst);
+	estimatedClocks = 0;
 
 	switch (decodedInst.opCode)
 	{
@@ -119,6 +122,7 @@ static void Estimator::EstimateClocks(const DecodedInstruction& decodedInst, int
 
 	case OpCode::op_add:
 	case OpCode::op_sub:
+	case OpCode::op_xor:
 		switch (decodedInst.DestOT)
 		{
 		case OperandType::ot_register:
@@ -196,7 +200,134 @@ static void Estimator::EstimateClocks(const DecodedInstruction& decodedInst, int
 
 		break;
 
+	case OpCode::op_test:
+		if (decodedInst.DestOT == OperandType::ot_memory || decodedInst.SourceOT == OperandType::ot_memory)
+		{
+			estimatedClocks = decodedInst.SourceOT == OperandType::ot_immediate ? 11 : 9;
+		}
+		else if (decodedInst.SourceOT == OperandType::ot_immediate)
+		{
+			estimatedClocks = decodedInst.DestOT == OperandType::ot_accumulator ? 4 : 5;
+		}
+		else // reg, reg
+		{
+			estimatedClocks = 3;
+		}
+
+		break;
+
+	case OpCode::op_inc:
+		if (decodedInst.DestOT == OperandType::ot_memory)
+		{
+			estimatedClocks = 15;
+		}
+		else
+		{
+			estimatedClocks = decodedInst.bWord ? 2 : 3;
+		}
+
+		break;
+
+	case OpCode::op_loop:
+		estimatedClocks = bBranchTaken ? 17 : 5;
+		break;
+
+	case OpCode::op_loopz:
+	case OpCode::op_jcxz:
+		estimatedClocks = bBranchTaken ? 18 : 6;
+		break;
+
+	case OpCode::op_loopnz:
+		estimatedClocks = bBranchTaken ? 19 : 5;
+		break;
+
+	case OpCode::op_undefined:
+		break;
+
+	default: // conditional jumps
+		estimatedClocks = bBranchTaken ? 16 : 4;
+		break;
+	}
+}
+
+int32_t Estimator::MemoryTransfers(const DecodedInstruction& decodedInst)
+{
+	if (decodedInst.DestOT != OperandType::ot_memory && decodedInst.SourceOT != OperandType::ot_memory)
+	{
+		return 0;
+	}
+
+	switch (decodedInst.opCode)
+	{
+	case OpCode::op_mov:
+	case OpCode::op_cmp:
+	case OpCode::op_test:
+		return 1;
+
+	// Read, modify, write back.
+	case OpCode::op_add:
+	case OpCode::op_sub:
+	case OpCode::op_xor:
+	case OpCode::op_inc:
+		return decodedInst.DestOT == OperandType::ot_memory ? 2 : 1;
+
 	default:
-		return;
+		return 0;
+	}
+}
+
+int32_t Estimator::WordTransfers(const DecodedInstruction& decodedInst)
+{
+	return decodedInst.bWord ? MemoryTransfers(decodedInst) : 0;
+}
+
+int32_t Estimator::BusPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst)
+{
+	return BusPenalty(chip.cpuTarget, decodedInst);
+}
+
+int32_t Estimator::OddAddressPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst)
+{
+	return OddAddressPenalty(chip.cpuTarget, decodedInst);
+}
+
+int32_t Estimator::BusPenalty(CpuTarget cpuTarget, const DecodedInstruction& decodedInst)
+{
+	return cpuTarget == CpuTarget::i8088 ? 4 * WordTransfers(decodedInst) : 0;
+}
+
+int32_t Estimator::OddAddressPenalty(CpuTarget cpuTarget, const DecodedInstruction& decodedInst)
+{
+	return cpuTarget == CpuTarget::i8086 ? 4 * WordTransfers(decodedInst) : 0;
+}
+
+int32_t Estimator::TransferPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst)
+{
+	return BusPenalty(chip, decodedInst) + ((decodedInst.memoryIndex & 1) ? OddAddressPenalty(chip, decodedInst) : 0);
+}
+
+// Whether the memory operand is a plain displacement, so its address is known without running the instruction.
+static bool IsDirectAddress(const DecodedInstruction& decodedInst)
+{
+	const Operand& memoryOperand = decodedInst.DestOT == OperandType::ot_memory ? decodedInst.Dest : decodedInst.Source;
+
+	return memoryOperand.address.base == Register::reg_none && memoryOperand.address.index == Register::reg_none;
+}
+
+int32_t Estimator::StaticPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst)
+{
+	const int32_t oddAddressPenalty = OddAddressPenalty(chip, decodedInst);
+	if (oddAddressPenalty == 0 || !IsDirectAddress(decodedInst))
+	{
+		return BusPenalty(chip, decodedInst);
 	}
+
+	const Operand& memoryOperand = decodedInst.DestOT == OperandType::ot_memory ? decodedInst.Dest : decodedInst.Source;
+
+	return BusPenalty(chip, decodedInst) + ((memoryOperand.address.displacement & 1) ? oddAddressPenalty : 0);
+}
+
+int32_t Estimator::DynamicPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst)
+{
+	return IsDirectAddress(decodedInst) ? 0 : OddAddressPenalty(chip, decodedInst);
 }
@@ -2,9 +2,44 @@
 #include <cstdint>
 
 struct DecodedInstruction;
+struct VirtualChip;
 
 namespace Estimator
 {
-	void EstimateClocks(const DecodedInstruction& decodedInst, int32_t& estimatedClocks, int32_t& ea);
-}
+	// Which bus the clocks are estimated for. The 8088 moves words a byte at a time.
+	enum class CpuTarget : uint8_t
+	{
+		i8086,
+		i8088
+	};
+
+	// Book clocks of the instruction plus its effective address clocks. Jumps, loops and jcxz cost more when
+	// taken, bBranchTaken is what Simulator::ExecuteInstruction returned for them.
+	void EstimateClocks(const DecodedInstruction& decodedInst, int32_t& estimatedClocks, int32_t& ea, bool bBranchTaken = false);
+
+	// Memory operand transfers the instruction makes, bytes or words.
+	int32_t MemoryTransfers(const DecodedInstruction& decodedInst);
+
+	// Word memory transfers the instruction makes, each costs 4 more clocks on an 8088 or at an odd address on an 8086.
+	int32_t WordTransfers(const DecodedInstruction& decodedInst);
+
+	// Penalties depend on chip.cpuTarget.
 
+	// Part of the transfer penalty that doesn't depend on the address, 4 clocks per word transfer on an 8088.
+	int32_t BusPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst);
+
+	// Part that only applies when the word is at an odd address, 4 clocks per word transfer on an 8086.
+	int32_t OddAddressPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst);
+
+	// The two for a cpu target without a chip.
+	int32_t BusPenalty(CpuTarget cpuTarget, const DecodedInstruction& decodedInst);
+	int32_t OddAddressPenalty(CpuTarget cpuTarget, const DecodedInstruction& decodedInst);
+
+	// Transfer penalty of an instruction that has executed, decodedInst.memoryIndex being its effective address.
+	int32_t TransferPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst);
+
+	// The same split for code compiled ahead of running it: what is known from the instruction alone, and the odd
+	// address penalty still to be charged at run time when the address comes from registers.
+	int32_t StaticPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst);
+	int32_t DynamicPenalty(const VirtualChip& chip, const DecodedInstruction& decodedInst);
+}
@@ -0,0 +1,724 @@
+#include <cstring>
+#include <algorithm>
+
+#include "sim8086.h"
+#include "sim8086_blocks.h"
+#include "sim8086_estimation.h"
+#include "sim8086_jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define SIM8086_JIT 1
+#endif
+
+// CF, PF, AF, ZF, SF and OF sit at the same bits in the host's RFLAGS and in VirtualChip::m_flags.
+static constexpr uint32_t arithmeticFlagsMask = 0x8D5;
+// Set in NativeFrame::flags when it holds the current arithmetic flags.
+static constexpr uint32_t pendingFlagsBit = 0x80000000;
+
+// What native code shares with ExecuteNative, kept in r13.
+struct NativeFrame
+{
+	// pendingFlagsBit and the arithmetic flags, or 0 while they're only known to the interpreter.
+	uint32_t flags = 0;
+	// How the branch closing the block went, or branchUndecided when the block engine has to work it out.
+	uint32_t branch = 0;
+	// The bits of m_flags outside arithmeticFlagsMask, no instruction native code runs changes them.
+	uint32_t otherFlags = 0;
+};
+
+static constexpr uint32_t branchUndecided = 0;
+static constexpr uint32_t branchNotTaken = 1;
+static constexpr uint32_t branchTaken = 2;
+
+static void MergePendingFlags(VirtualChip& chip, uint32_t flags)
+{
+	if (flags & pendingFlagsBit)
+	{
+		// Native code sets every arithmetic flag, whatever the interpreter left pending is stale.
+		chip.m_lazyFlags.opCode = OpCode::op_undefined;
+
+		const unsigned long merged = (chip.m_flags.to_ulong() & ~static_cast<unsigned long>(arithmeticFlagsMask)) | (flags & arithmeticFlagsMask);
+		chip.m_flags = std::bitset<16>(merged);
+	}
+}
+
+static ThreadedOp* ExecuteNative(ThreadedOp* op)
+{
+	VirtualChip& chip = *op->chip;
+
+	NativeFrame frame{};
+	frame.otherFlags = static_cast<uint32_t>(chip.m_flags.to_ulong()) & ~arithmeticFlagsMask;
+	if (chip.m_lazyFlags.opCode == OpCode::op_undefined)
+	{
+		frame.flags = pendingFlagsBit | (static_cast<uint32_t>(chip.m_flags.to_ulong()) & arithmeticFlagsMask);
+	}
+
+	// Runs this block and whatever it's chained to, and returns the exit op of the last one or the op to resume at.
+	ThreadedOp* next = op->native(chip.m_registers.words, chip.m_memory.data(), &frame);
+	MergePendingFlags(chip, frame.flags);
+
+	if (frame.branch == branchUndecided)
+	{
+		return next;
+	}
+
+	Block& block = *next->block;
+	const bool bTaken = frame.branch == branchTaken;
+
+	ThreadedOp* successor = LeaveBlock(next, bTaken);
+
+	// Once both ends are native the edge stays in native code, except where FastForward can skip the loop.
+	if (successor && successor->handler == &ExecuteNative && !(bTaken && successor->block == &block && block.loop.bValid))
+	{
+		(bTaken ? block.nativeTaken : block.nativeNext) = successor->block->nativeEntry;
+	}
+
+	return successor;
+}
+
+// Instructions that don't change the simulated state apart from ip.
+static bool IsNoOp(const DecodedInstruction& decodedInst)
+{
+	return decodedInst.opCode == OpCode::op_undefined || decodedInst.opCode == OpCode::op_test;
+}
+
+// Byte add, sub and cmp set SF and OF from 16 bits, which the host can't do.
+static bool IsNative(const DecodedInstruction& decodedInst)
+{
+	return decodedInst.opCode == OpCode::op_mov || (decodedInst.bWord && !IsNoOp(decodedInst));
+}
+
+static bool SetsFlags(const DecodedInstruction& decodedInst)
+{
+	return decodedInst.opCode != OpCode::op_mov && !IsNoOp(decodedInst);
+}
+
+static bool ReadsFlags(OpCode opCode)
+{
+	return opCode != OpCode::op_undefined && opCode != OpCode::op_loop && opCode != OpCode::op_loopz && opCode != OpCode::op_jcxz;
+}
+
+// Native code is called as ThreadedOp*(uint16_t* registers, uint8_t* memory, NativeFrame* frame) and keeps
+// the three in rbx, r12 and r13. Clocks, dirty pages, fallbacks and chained blocks are at addresses fixed in the code.
+class Emitter
+{
+public:
+	explicit Emitter(VirtualChip& chip)
+		: m_chip(chip)
+	{
+		code.reserve(256);
+	}
+
+	// Blocks chained to one another start past it, see Block::nativeEntry.
+	static constexpr size_t prologueSize = 14;
+
+	void Prologue()
+	{
+		Bytes({ 0x53 });             // push rbx
+		Bytes({ 0x41, 0x54 });       // push r12
+		Bytes({ 0x41, 0x55 });       // push r13
+		Bytes({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+		Bytes({ 0x49, 0x89, 0xF4 }); // mov r12, rsi
+		Bytes({ 0x49, 0x89, 0xD5 }); // mov r13, rdx
+	}
+
+	// Returns op with NativeFrame::branch = branch.
+	void Return(const ThreadedOp* op, uint32_t branch)
+	{
+		Bytes({ 0x41, 0xC7, 0x45, 0x04 });     // mov dword [r13 + 4], imm32
+		Dword(branch);
+		Bytes({ 0x48, 0xB8 });                 // mov rax, imm64
+		Qword(reinterpret_cast<uint64_t>(op));
+		Bytes({ 0x41, 0x5D });                 // pop r13
+		Bytes({ 0x41, 0x5C });                 // pop r12
+		Bytes({ 0x5B });                       // pop rbx
+		Bytes({ 0xC3 });                       // ret
+	}
+
+	// ecx = effective address of a memory operand.
+	void EffectiveAddress(const EffectiveAddress& address)
+	{
+		if (address.base == Register::reg_none && address.index == Register::reg_none)
+		{
+			Bytes({ 0xB9 }); // mov ecx, imm32
+			Dword(static_cast<uint16_t>(address.displacement));
+			return;
+		}
+
+		const Register first = address.base != Register::reg_none ? address.base : address.index;
+		Bytes({ 0x0F, 0xB7, 0x4B, RegisterOffset(first) }); // movzx ecx, word [rbx + first]
+
+		if (address.base != Register::reg_none && address.index != Register::reg_none)
+		{
+			Bytes({ 0x66, 0x03, 0x4B, RegisterOffset(address.index) }); // add cx, [rbx + index]
+		}
+
+		if (address.displacement != 0)
+		{
+			Bytes({ 0x66, 0x81, 0xC1 }); // add cx, imm16
+			Word(static_cast<uint16_t>(address.displacement));
+		}
+	}
+
+	// ax = source operand.
+	void LoadSource(const DecodedInstruction& decodedInst)
+	{
+		switch (decodedInst.SourceOT)
+		{
+		case OperandType::ot_immediate:
+			Bytes({ 0x66, 0xB8 }); // mov ax, imm16
+			Word(static_cast<uint16_t>(decodedInst.Source.immediate));
+			break;
+
+		case OperandType::ot_memory:
+			EffectiveAddress(decodedInst.Source.address);
+			ChargeOddAddress(Estimator::DynamicPenalty(m_chip, decodedInst));
+			Bytes({ 0x66, 0x41, 0x8B, 0x04, 0x0C }); // mov ax, [r12 + rcx]
+			break;
+
+		default:
+			Bytes({ 0x66, 0x8B, 0x43, RegisterOffset(decodedInst.Source.reg.index) }); // mov ax, [rbx + reg]
+			break;
+		}
+	}
+
+	// op dest, ax
+	void Operate(const DecodedInstruction& decodedInst)
+	{
+		uint8_t opByte = 0x89;
+		switch (decodedInst.opCode)
+		{
+		case OpCode::op_add:
+			opByte = 0x01;
+			break;
+		case OpCode::op_sub:
+			opByte = 0x29;
+			break;
+		case OpCode::op_cmp:
+			opByte = 0x39;
+			break;
+		default:
+			break;
+		}
+
+		if (decodedInst.DestOT == OperandType::ot_memory)
+		{
+			EffectiveAddress(decodedInst.Dest.address);
+			ChargeOddAddress(Estimator::DynamicPenalty(m_chip, decodedInst));
+
+			if (decodedInst.opCode != OpCode::op_cmp)
+			{
+				MarkDirty(sizeof(uint16_t));
+			}
+
+			Bytes({ 0x66, 0x41, opByte, 0x04, 0x0C }); // op [r12 + rcx], ax
+		}
+		else
+		{
+			Bytes({ 0x66, opByte, 0x43, RegisterOffset(decodedInst.Dest.reg.index) }); // op [rbx + reg], ax
+		}
+	}
+
+	// mov dest, source on bytes, through al.
+	void MoveByte(const DecodedInstruction& decodedInst)
+	{
+		switch (decodedInst.SourceOT)
+		{
+		case OperandType::ot_immediate:
+			Bytes({ 0xB0, static_cast<uint8_t>(decodedInst.Source.immediate) }); // mov al, imm8
+			break;
+
+		case OperandType::ot_memory:
+			EffectiveAddress(decodedInst.Source.address);
+			Bytes({ 0x41, 0x8A, 0x04, 0x0C });                                   // mov al, [r12 + rcx]
+			break;
+
+		default:
+			Bytes({ 0x8A, 0x43, ByteOffset(decodedInst.Source.reg) });           // mov al, [rbx + reg]
+			break;
+		}
+
+		if (decodedInst.DestOT == OperandType::ot_memory)
+		{
+			EffectiveAddress(decodedInst.Dest.address);
+			MarkDirty(sizeof(uint8_t));
+			Bytes({ 0x41, 0x88, 0x04, 0x0C });                                   // mov [r12 + rcx], al
+		}
+		else
+		{
+			Bytes({ 0x88, 0x43, ByteOffset(decodedInst.Dest.reg) });             // mov [rbx + reg], al
+		}
+	}
+
+	// totalClocks += penalty when ecx is odd, clobbering rdx and the host flags.
+	void ChargeOddAddress(int32_t penalty)
+	{
+		if (penalty == 0)
+		{
+			return;
+		}
+
+		Bytes({ 0x48, 0xBA });                   // mov rdx, imm64
+		Qword(reinterpret_cast<uint64_t>(&m_chip.totalClocks));
+		Bytes({ 0xF6, 0xC1, 0x01 });             // test cl, 1
+		Bytes({ 0x74, 0x04 });                   // jz past the add
+		Bytes({ 0x48, 0x83, 0x02, static_cast<uint8_t>(penalty) }); // add qword [rdx], penalty
+	}
+
+	// Marks the pages of the size bytes at [r12 + rcx] in VirtualChip::m_dirtyPages, clobbering rdx, rsi and the host flags.
+	void MarkDirty(size_t size)
+	{
+		Bytes({ 0x48, 0xBA });                   // mov rdx, imm64
+		Qword(reinterpret_cast<uint64_t>(m_chip.m_dirtyPages.data()));
+		Bytes({ 0x89, 0xCE });                   // mov esi, ecx
+		Bytes({ 0xC1, 0xEE, static_cast<uint8_t>(VirtualChip::pageShift) }); // shr esi, pageShift
+		Bytes({ 0xC6, 0x04, 0x32, 0x01 });       // mov byte [rdx + rsi], 1
+
+		if (size > 1)
+		{
+			Bytes({ 0x8D, 0x71, 0x01 });         // lea esi, [rcx + 1]
+			Bytes({ 0xC1, 0xEE, static_cast<uint8_t>(VirtualChip::pageShift) }); // shr esi, pageShift
+			Bytes({ 0xC6, 0x04, 0x32, 0x01 });   // mov byte [rdx + rsi], 1
+		}
+	}
+
+	// Hands the arithmetic flags of the last operation to the branch, the next block or MergePendingFlags.
+	void StoreFlags()
+	{
+		Bytes({ 0x9C });                         // pushfq
+		Bytes({ 0x58 });                         // pop rax
+		Bytes({ 0x25 });                         // and eax, imm32
+		Dword(arithmeticFlagsMask);
+		Bytes({ 0x0D });                         // or eax, imm32
+		Dword(pendingFlagsBit);
+		Bytes({ 0x41, 0x89, 0x45, 0x00 });       // mov [r13], eax
+	}
+
+	// Runs op through its threaded handler, which leaves the flags with the interpreter.
+	void CallHandler(const ThreadedOp* op)
+	{
+		Bytes({ 0x41, 0xC7, 0x45, 0x00 });       // mov dword [r13], imm32
+		Dword(0);
+		Bytes({ 0x48, 0xBF });                   // mov rdi, imm64
+		Qword(reinterpret_cast<uint64_t>(op));
+		Bytes({ 0x48, 0xB8 });                   // mov rax, imm64
+		Qword(reinterpret_cast<uint64_t>(op->handler));
+		Bytes({ 0xFF, 0xD0 });                   // call rax
+	}
+
+	// eax = the flags, jumps to the returned fixup when they're with the interpreter and bKnown isn't set.
+	size_t LoadFlags(bool bKnown)
+	{
+		size_t unknown = noJump;
+
+		Bytes({ 0x41, 0x8B, 0x45, 0x00 });       // mov eax, [r13]
+		if (!bKnown)
+		{
+			Bytes({ 0x85, 0xC0 });               // test eax, eax
+			unknown = JumpIf(0x89);              // jns
+		}
+		Bytes({ 0x41, 0x0B, 0x45, 0x08 });       // or eax, [r13 + 8]
+
+		return unknown;
+	}
+
+	// Jumps to the returned fixup when the branch, reading the flags from eax, is taken.
+	size_t Branch(OpCode opCode)
+	{
+		switch (opCode)
+		{
+		case OpCode::op_je:
+			return TestFlags(0x40, 0x85);
+		case OpCode::op_jne:
+			return TestFlags(0x40, 0x84);
+		case OpCode::op_jl:
+		case OpCode::op_js:
+		case OpCode::op_jns:
+			return TestFlags(0x80, 0x85);
+		case OpCode::op_jnl:
+			return TestFlags(0x80, 0x84);
+		case OpCode::op_jle:
+			return TestFlags(0xC0, 0x85);
+		case OpCode::op_jnle:
+			Bytes({ 0x25 });                     // and eax, imm32
+			Dword(0xC0);
+			Bytes({ 0x3D });                     // cmp eax, imm32
+			Dword(0x80);
+			return JumpIf(0x84);                 // je
+		case OpCode::op_jb:
+			return TestFlags(0x02, 0x85);
+		case OpCode::op_jbe:
+			return TestFlags(0x42, 0x85);
+		case OpCode::op_jnb:
+			return TestFlags(0x02, 0x84);
+		case OpCode::op_jnbe:
+			return TestFlags(0x42, 0x84);
+		case OpCode::op_jp:
+			return TestFlags(0x04, 0x85);
+		case OpCode::op_jnp:
+			return TestFlags(0x04, 0x84);
+		case OpCode::op_jo:
+		case OpCode::op_jno:
+			return TestFlags(0x800, 0x84);
+
+		case OpCode::op_loop:
+		{
+			Bytes({ 0x66, 0x83, 0x7B, 0x02, 0x00 }); // cmp word [rbx + 2], 0
+			const size_t notTaken = JumpIf(0x84);    // je
+			DecrementCx();
+			const size_t taken = Jump();
+			Land(notTaken);
+			return taken;
+		}
+		case OpCode::op_loopz:
+			DecrementCx();
+			return JumpIf(0x85);                 // jnz
+		case OpCode::op_loopnz:
+		{
+			DecrementCx();
+			const size_t notTaken = JumpIf(0x84); // jz
+			const size_t taken = TestFlags(0x40, 0x84);
+			Land(notTaken);
+			return taken;
+		}
+		case OpCode::op_jcxz:
+			Bytes({ 0x66, 0x83, 0x7B, 0x02, 0x00 }); // cmp word [rbx + 2], 0
+			return JumpIf(0x84);                 // je
+
+		default:
+			return noJump;
+		}
+	}
+
+	// Continues in the block chained at slot, or returns exitOp with its branch when there's none yet or the
+	// instruction limit is reached.
+	void Leave(const Block& block, const ThreadedOp* exitOp, bool bTaken)
+	{
+		const uint8_t* const* slot = bTaken ? &block.nativeTaken : &block.nativeNext;
+		BlockEngine& engine = *exitOp->engine;
+
+		Bytes({ 0x48, 0xBA });                   // mov rdx, imm64
+		Qword(reinterpret_cast<uint64_t>(slot));
+		Bytes({ 0x48, 0x8B, 0x12 });             // mov rdx, [rdx]
+		Bytes({ 0x48, 0x85, 0xD2 });             // test rdx, rdx
+		const size_t unchained = JumpIf(0x84);   // jz
+
+		// What LeaveBlock would account for, it still does when the limit is reached.
+		Bytes({ 0x48, 0xBE });                   // mov rsi, imm64
+		Qword(reinterpret_cast<uint64_t>(&engine.instructionsExecuted));
+		Bytes({ 0x48, 0x8B, 0x06 });             // mov rax, [rsi]
+		Bytes({ 0x48, 0x05 });                   // add rax, imm32
+		Dword(block.instructionCount);
+		Bytes({ 0x48, 0xB9 });                   // mov rcx, imm64
+		Qword(reinterpret_cast<uint64_t>(&engine.instructionLimit));
+		Bytes({ 0x48, 0x3B, 0x01 });             // cmp rax, [rcx]
+		const size_t limited = JumpIf(0x83);     // jae
+		Bytes({ 0x48, 0x89, 0x06 });             // mov [rsi], rax
+		Bytes({ 0x48, 0xB9 });                   // mov rcx, imm64
+		Qword(reinterpret_cast<uint64_t>(&m_chip.totalClocks));
+		Bytes({ 0x48, 0x81, 0x01 });             // add qword [rcx], imm32
+		Dword(static_cast<uint32_t>(block.clocks + (bTaken ? block.takenClocks : 0)));
+		Bytes({ 0xFF, 0xE2 });                   // jmp rdx
+
+		Land(unchained);
+		Land(limited);
+		Return(exitOp, bTaken ? branchTaken : branchNotTaken);
+	}
+
+	// Points the rel32 jump at fixup to the end of the code.
+	void Land(size_t fixup)
+	{
+		if (fixup == noJump)
+		{
+			return;
+		}
+
+		const uint32_t distance = static_cast<uint32_t>(code.size() - (fixup + 4));
+		std::memcpy(code.data() + fixup, &distance, sizeof(distance));
+	}
+
+	static constexpr size_t noJump = SIZE_MAX;
+
+	std::vector<uint8_t> code{};
+
+private:
+	VirtualChip& m_chip;
+
+	static uint8_t RegisterOffset(Register reg)
+	{
+		return static_cast<uint8_t>(static_cast<uint8_t>(reg) * sizeof(uint16_t));
+	}
+
+	static uint8_t ByteOffset(const RegisterAccess& reg)
+	{
+		return static_cast<uint8_t>(RegisterOffset(reg.index) + reg.offset);
+	}
+
+	// test eax, mask and a jcc with condition on the result.
+	size_t TestFlags(uint32_t mask, uint8_t condition)
+	{
+		Bytes({ 0xA9 });                         // test eax, imm32
+		Dword(mask);
+		return JumpIf(condition);
+	}
+
+	void DecrementCx()
+	{
+		Bytes({ 0x66, 0x83, 0x6B, 0x02, 0x01 }); // sub word [rbx + 2], 1
+	}
+
+	// jcc rel32, condition being the second opcode byte. Returns where the distance goes, see Land.
+	size_t JumpIf(uint8_t condition)
+	{
+		Bytes({ 0x0F, condition });
+		Dword(0);
+		return code.size() - 4;
+	}
+
+	size_t Jump()
+	{
+		Bytes({ 0xE9 });                         // jmp rel32
+		Dword(0);
+		return code.size() - 4;
+	}
+
+	void Bytes(std::initializer_list<uint8_t> bytes)
+	{
+		code.insert(code.end(), bytes);
+	}
+
+	void Word(uint16_t value)
+	{
+		Bytes({ static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) });
+	}
+
+	void Dword(uint32_t value)
+	{
+		Word(static_cast<uint16_t>(value));
+		Word(static_cast<uint16_t>(value >> 16));
+	}
+
+	void Qword(uint64_t value)
+	{
+		Dword(static_cast<uint32_t>(value));
+		Dword(static_cast<uint32_t>(value >> 32));
+	}
+};
+
+Jit::~Jit()
+{
+#ifdef SIM8086_JIT
+	for (const CodeChunk& chunk : m_chunks)
+	{
+		munmap(chunk.memory, chunk.size);
+	}
+#endif
+}
+
+bool Jit::IsSupported()
+{
+#ifdef SIM8086_JIT
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Jit::Compile(Block& block)
+{
+	if (!IsSupported() || block.ops.size() < 2)
+	{
+		return false;
+	}
+
+	ThreadedOp& exitOp = block.ops.back();
+	const size_t exitIndex = block.ops.size() - 1;
+
+	// A byte add, sub or cmp fused with the branch leaves the block itself, native code stops in front of it.
+	size_t bodySize = exitIndex;
+	if (exitOp.opCode != OpCode::op_undefined && !IsNative(block.instructions[block.ops[exitIndex - 1].instruction]) &&
+		!IsNoOp(block.instructions[block.ops[exitIndex - 1].instruction]))
+	{
+		--bodySize;
+	}
+
+	size_t nativeCount = 0;
+	size_t fallbackCount = 0;
+	for (size_t i{ 0 }; i < bodySize; ++i)
+	{
+		const DecodedInstruction& decodedInst = block.instructions[block.ops[i].instruction];
+		nativeCount += IsNative(decodedInst);
+		fallbackCount += !IsNative(decodedInst) && !IsNoOp(decodedInst);
+	}
+
+	// A fallback costs a threaded op and a call, it takes a native op to win that back.
+	if (nativeCount == 0 || fallbackCount > nativeCount)
+	{
+		return false;
+	}
+
+	VirtualChip& chip = *exitOp.chip;
+
+	Emitter emitter(chip);
+	emitter.Prologue();
+
+	// Which op set the flags the branch reads, if any in this block did.
+	const DecodedInstruction* lastFlagsInst = nullptr;
+
+	for (size_t i{ 0 }; i < bodySize; ++i)
+	{
+		const ThreadedOp& op = block.ops[i];
+		const DecodedInstruction& decodedInst = block.instructions[op.instruction];
+
+		if (IsNoOp(decodedInst))
+		{
+			// Nothing to simulate, but a word at an odd address still costs clocks.
+			emitter.EffectiveAddress(decodedInst.DestOT == OperandType::ot_memory ? decodedInst.Dest.address : decodedInst.Source.address);
+			emitter.ChargeOddAddress(op.oddPenalty);
+			continue;
+		}
+
+		if (SetsFlags(decodedInst))
+		{
+			lastFlagsInst = &decodedInst;
+		}
+
+		if (!IsNative(decodedInst))
+		{
+			emitter.CallHandler(&op);
+			continue;
+		}
+
+		if (!decodedInst.bWord)
+		{
+			emitter.MoveByte(decodedInst);
+			continue;
+		}
+
+		emitter.LoadSource(decodedInst);
+		emitter.Operate(decodedInst);
+
+		if (!SetsFlags(decodedInst))
+		{
+			continue;
+		}
+
+		// Flags only need to leave the host when nothing after it in the block overwrites them.
+		bool bFlagsLive = true;
+		for (size_t j{ i + 1 }; j < exitIndex; ++j)
+		{
+			if (SetsFlags(block.instructions[block.ops[j].instruction]))
+			{
+				bFlagsLive = false;
+				break;
+			}
+		}
+
+		if (bFlagsLive)
+		{
+			emitter.StoreFlags();
+		}
+	}
+
+	if (bodySize < exitIndex)
+	{
+		emitter.Return(&block.ops[bodySize], branchUndecided);
+	}
+	else if (ReadsFlags(exitOp.opCode) && lastFlagsInst && !IsNative(*lastFlagsInst))
+	{
+		emitter.Return(&exitOp, branchUndecided);
+	}
+	else
+	{
+		// Flags set in an earlier block may still be with the interpreter.
+		size_t unknownFlags = Emitter::noJump;
+		if (ReadsFlags(exitOp.opCode))
+		{
+			unknownFlags = emitter.LoadFlags(lastFlagsInst != nullptr);
+		}
+
+		const size_t taken = emitter.Branch(exitOp.opCode);
+		emitter.Leave(block, &exitOp, false);
+
+		if (taken != Emitter::noJump)
+		{
+			emitter.Land(taken);
+			emitter.Leave(block, &exitOp, true);
+		}
+
+		if (unknownFlags != Emitter::noJump)
+		{
+			emitter.Land(unknownFlags);
+			emitter.Return(&exitOp, branchUndecided);
+		}
+	}
+
+	uint8_t* code = Install(emitter.code);
+	if (!code)
+	{
+		return false;
+	}
+
+	block.nativeEntry = code + Emitter::prologueSize;
+
+	// Handlers of the ops native code falls back to were captured above, the entry op can go.
+	ThreadedOp& entry = block.ops.front();
+	entry.native = reinterpret_cast<ThreadedOp* (*)(uint16_t*, uint8_t*, NativeFrame*)>(code);
+	entry.handler = &ExecuteNative;
+	entry.block = &block;
+
+	++compiledBlocks;
+
+	return true;
+}
+
+#ifdef SIM8086_JIT
+uint8_t* Jit::Install(const std::vector<uint8_t>& code)
+{
+	static constexpr size_t chunkSize = 1 << 20;
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+	if (m_chunks.empty() || m_chunks.back().used + code.size() > m_chunks.back().size)
+	{
+		const size_t allocationSize = std::max(chunkSize, (code.size() + pageSize - 1) / pageSize * pageSize);
+
+		void* memory = mmap(nullptr, allocationSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		m_chunks.push_back({ static_cast<uint8_t*>(memory), allocationSize, 0 });
+	}
+
+	CodeChunk& chunk = m_chunks.back();
+	uint8_t* installed = chunk.memory + chunk.used;
+
+	// Pages are only writable while the code is copied in.
+	uint8_t* firstPage = chunk.memory + chunk.used / pageSize * pageSize;
+	const size_t protectSize = static_cast<size_t>(installed + code.size() - firstPage);
+
+	if (mprotect(firstPage, protectSize, PROT_READ | PROT_WRITE) != 0)
+	{
+		return nullptr;
+	}
+
+	std::memcpy(installed, code.data(), code.size());
+
+	if (mprotect(firstPage, protectSize, PROT_READ | PROT_EXEC) != 0)
+	{
+		return nullptr;
+	}
+
+	chunk.used += code.size();
+
+	return installed;
+}
+#else
+uint8_t* Jit::Install(const std::vector<uint8_t>& code)
+{
+	return nullptr;
+}
+#endif
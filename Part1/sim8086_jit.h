@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct Block;
+
+// Translates hot blocks of the BlockEngine to x86-64. Byte mov and word mov, add, sub and cmp with register,
+// immediate and memory operands are emitted natively, byte add, sub and cmp call their threaded handler. The
+// branch closing the block is decided natively and jumps straight into its successor once that's translated too.
+class Jit
+{
+public:
+	Jit() = default;
+	~Jit();
+
+	Jit(const Jit&) = delete;
+	Jit& operator=(const Jit&) = delete;
+
+	// Replaces the body of the block with native code. False when there is nothing worth translating or
+	// the host can't run it, in which case the block keeps running threaded.
+	bool Compile(Block& block);
+
+	// Whether Compile can ever succeed on this host.
+	static bool IsSupported();
+
+	// Times a block is entered before it's translated.
+	static constexpr uint32_t hotThreshold = 16;
+
+	uint32_t compiledBlocks = 0;
+
+private:
+	// Copies code into executable memory.
+	uint8_t* Install(const std::vector<uint8_t>& code);
+
+	struct CodeChunk
+	{
+		uint8_t* memory = nullptr;
+		size_t size = 0;
+		size_t used = 0;
+	};
+
+	std::vector<CodeChunk> m_chunks{};
+};
@@ -0,0 +1,113 @@
+#include "sim8086_loader.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SIM8086_MMAP 1
+#endif
+
+ProgramImage::~ProgramImage()
+{
+	Close();
+}
+
+bool ProgramImage::Open(const char* filePath)
+{
+	Close();
+
+	return Map(filePath) || Read(filePath);
+}
+
+#ifdef SIM8086_MMAP
+bool ProgramImage::Map(const char* filePath)
+{
+	const int fd = open(filePath, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat {};
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	const size_t fileSize = static_cast<size_t>(fileStat.st_size);
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t filePages = (fileSize + pageSize - 1) / pageSize * pageSize;
+
+	// Reserve one zero page past the file and map the file over the front of it.
+	void* reserved = mmap(nullptr, filePages + pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (reserved == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(reserved, fileSize, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED)
+	{
+		munmap(reserved, filePages + pageSize);
+		return false;
+	}
+
+	m_mapping = reserved;
+	m_mappingSize = filePages + pageSize;
+	m_data = static_cast<const uint8_t*>(mapped);
+	m_size = fileSize;
+
+	return true;
+}
+#else
+bool ProgramImage::Map(const char* filePath)
+{
+	return false;
+}
+#endif
+
+bool ProgramImage::Read(const char* filePath)
+{
+	std::ifstream inf{ filePath, std::ios::binary | std::ios::ate };
+	if (!inf)
+	{
+		return false;
+	}
+
+	const size_t fileSize = static_cast<size_t>(inf.tellg());
+	inf.seekg(0);
+
+	m_buffer.assign(fileSize + padding, 0);
+	if (!inf.read(reinterpret_cast<char*>(m_buffer.data()), static_cast<std::streamsize>(fileSize)))
+	{
+		m_buffer.clear();
+		return false;
+	}
+
+	m_data = m_buffer.data();
+	m_size = fileSize;
+
+	return true;
+}
+
+void ProgramImage::Close()
+{
+#ifdef SIM8086_MMAP
+	if (m_mapping)
+	{
+		munmap(m_mapping, m_mappingSize);
+	}
+#endif
+
+	m_mapping = nullptr;
+	m_mappingSize = 0;
+	m_buffer.clear();
+	m_data = nullptr;
+	m_size = 0;
+}
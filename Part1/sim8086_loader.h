@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read only view of a program file, memory mapped where the platform allows it and read in one go otherwise.
+// At least ProgramImage::padding zero bytes follow the program, so decoding a truncated last instruction stays in bounds.
+class ProgramImage
+{
+public:
+	ProgramImage() = default;
+	~ProgramImage();
+
+	ProgramImage(const ProgramImage&) = delete;
+	ProgramImage& operator=(const ProgramImage&) = delete;
+
+	bool Open(const char* filePath);
+
+	inline const uint8_t* Data() const
+	{
+		return m_data;
+	}
+
+	inline size_t Size() const
+	{
+		return m_size;
+	}
+
+	static constexpr size_t padding = 16;
+
+private:
+	bool Map(const char* filePath);
+	bool Read(const char* filePath);
+	void Close();
+
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+	void* m_mapping = nullptr;
+	size_t m_mappingSize = 0;
+
+	std::vector<uint8_t> m_buffer{};
+};
@@ -0,0 +1,573 @@
+#include <algorithm>
+
+#include "sim8086_estimation.h"
+#include "sim8086_lockstep.h"
+
+// Every loop over lanes below is written so it vectorizes: no early exits, selects instead of branches.
+
+template <size_t laneCount>
+LockstepEngine<laneCount>::LockstepEngine(const uint8_t* program, size_t programSize, Estimator::CpuTarget cpuTarget)
+	: m_program(program)
+	, m_programSize(programSize)
+	, m_cpuTarget(cpuTarget)
+	, m_blocks(programSize)
+	, m_memory(addressableBytes * laneCount)
+{
+}
+
+template <size_t laneCount>
+void LockstepEngine<laneCount>::SetRegister(size_t lane, Register reg, uint16_t value)
+{
+	m_registers[static_cast<size_t>(reg)].value[lane] = value;
+
+	Lanes mask{};
+	mask.value[lane] = 0xffff;
+	AddMutatedRegister(static_cast<size_t>(reg), mask);
+}
+
+template <size_t laneCount>
+void LockstepEngine<laneCount>::Run()
+{
+	while (instructionsIssued < instructionLimit)
+	{
+		uint32_t apart = 0;
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			apart |= m_ip[lane] ^ m_ip[0];
+		}
+
+		uint32_t ip = m_ip[0];
+		uint32_t waitingIp = UINT32_MAX;
+
+		// Lanes that went different ways: the ones at the lowest ip run until they get to the next lowest one,
+		// where the lanes waiting there join them.
+		if (apart)
+		{
+			for (size_t lane{ 0 }; lane < laneCount; ++lane)
+			{
+				ip = std::min(ip, m_ip[lane]);
+			}
+
+			for (size_t lane{ 0 }; lane < laneCount; ++lane)
+			{
+				waitingIp = std::min(waitingIp, m_ip[lane] == ip ? UINT32_MAX : m_ip[lane]);
+			}
+		}
+
+		// Lanes that left the program are past its end, so never at the lowest ip while any other lane runs.
+		if (ip >= m_programSize)
+		{
+			break;
+		}
+
+		Lanes mask;
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			mask.value[lane] = m_ip[lane] == ip ? 0xffff : 0;
+		}
+
+		int32_t clocks = 0;
+		uint32_t executed = 0;
+		uint32_t nextIp = ip;
+		bool bBranched = false;
+
+		for (const LaneInstruction& instruction : GetBlock(ip).instructions)
+		{
+			if (instruction.ip >= waitingIp || instructionsIssued >= instructionLimit)
+			{
+				break;
+			}
+
+			++executed;
+			++instructionsIssued;
+			nextIp = instruction.nextIp;
+
+			if (Execute(instruction, mask))
+			{
+				bBranched = true;
+			}
+			else
+			{
+				clocks += instruction.clocks;
+			}
+		}
+
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			const uint32_t active = mask.value[lane] & 1;
+			m_clocks[lane] += active * clocks;
+			m_laneInstructions[lane] += active * executed;
+			m_ip[lane] = active && !bBranched ? nextIp : m_ip[lane];
+		}
+	}
+
+	// So LaneState finds every flag in m_flags.
+	ComputeFlags();
+}
+
+template <size_t laneCount>
+const typename LockstepEngine<laneCount>::LaneBlock& LockstepEngine<laneCount>::GetBlock(uint32_t ip)
+{
+	if (m_blocks[ip])
+	{
+		return *m_blocks[ip];
+	}
+
+	m_blocks[ip] = std::make_unique<LaneBlock>();
+	LaneBlock& block = *m_blocks[ip];
+
+	while (ip < m_programSize)
+	{
+		LaneInstruction& instruction = block.instructions.emplace_back();
+		DecodedInstruction& decodedInst = instruction.decodedInst;
+		Decoder::Disasm(m_program, ip, decodedInst);
+
+		instruction.ip = ip;
+		ip += static_cast<uint32_t>(decodedInst.extraBits + 1);
+		instruction.nextIp = ip;
+
+		int32_t ea = 0;
+		Estimator::EstimateClocks(decodedInst, instruction.clocks, ea);
+		instruction.clocks += ea + Estimator::BusPenalty(m_cpuTarget, decodedInst);
+
+		Estimator::EstimateClocks(decodedInst, instruction.takenClocks, ea, true);
+		instruction.takenClocks += ea;
+
+		instruction.oddAddressPenalty = Estimator::OddAddressPenalty(m_cpuTarget, decodedInst);
+
+		if (decodedInst.DestOT == OperandType::ot_jumpTarget)
+		{
+			break;
+		}
+	}
+
+	return block;
+}
+
+template <size_t laneCount>
+void LockstepEngine<laneCount>::Read(const Operand& operand, OperandType type, bool bWord, const Lanes& address, Lanes& value) const
+{
+	switch (type)
+	{
+	case OperandType::ot_register:
+	case OperandType::ot_accumulator:
+	{
+		const Lanes& reg = m_registers[static_cast<size_t>(operand.reg.index)];
+		const uint32_t shift = bWord ? 0 : 8u * operand.reg.offset;
+		const uint16_t width = bWord ? 0xffff : 0xff;
+
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			value.value[lane] = static_cast<uint16_t>((reg.value[lane] >> shift) & width);
+		}
+		break;
+	}
+
+	case OperandType::ot_immediate:
+	{
+		const uint16_t immediate = bWord ? static_cast<uint16_t>(operand.immediate) : static_cast<uint8_t>(operand.immediate);
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			value.value[lane] = immediate;
+		}
+		break;
+	}
+
+	case OperandType::ot_memory:
+		// A direct address is the same in every lane, so are its rows.
+		if (operand.address.base == Register::reg_none && operand.address.index == Register::reg_none)
+		{
+			const uint8_t* row = &m_memory[static_cast<uint16_t>(operand.address.displacement) * laneCount];
+			for (size_t lane{ 0 }; lane < laneCount; ++lane)
+			{
+				value.value[lane] = static_cast<uint16_t>(bWord ? row[lane] | (row[laneCount + lane] << 8) : row[lane]);
+			}
+			break;
+		}
+
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			const uint8_t* bytes = &m_memory[address.value[lane] * laneCount + lane];
+			value.value[lane] = static_cast<uint16_t>(bWord ? bytes[0] | (bytes[laneCount] << 8) : bytes[0]);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+template <size_t laneCount>
+void LockstepEngine<laneCount>::Write(const Operand& operand, OperandType type, bool bWord, const Lanes& address, const Lanes& mask, const Lanes& value)
+{
+	if (type == OperandType::ot_register || type == OperandType::ot_accumulator)
+	{
+		Lanes& reg = m_registers[static_cast<size_t>(operand.reg.index)];
+		const uint32_t shift = bWord ? 0 : 8u * operand.reg.offset;
+		const uint16_t keep = bWord ? 0 : static_cast<uint16_t>(~(0xff << shift));
+
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			const uint16_t written = static_cast<uint16_t>((reg.value[lane] & keep) | (value.value[lane] << shift));
+			reg.value[lane] = static_cast<uint16_t>((written & mask.value[lane]) | (reg.value[lane] & ~mask.value[lane]));
+		}
+	}
+	else if (type == OperandType::ot_memory && operand.address.base == Register::reg_none && operand.address.index == Register::reg_none)
+	{
+		uint8_t* row = &m_memory[static_cast<uint16_t>(operand.address.displacement) * laneCount];
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			const uint8_t keep = static_cast<uint8_t>(~mask.value[lane]);
+			row[lane] = static_cast<uint8_t>((row[lane] & keep) | (value.value[lane] & mask.value[lane]));
+
+			if (bWord)
+			{
+				row[laneCount + lane] = static_cast<uint8_t>((row[laneCount + lane] & keep) | ((value.value[lane] >> 8) & mask.value[lane]));
+			}
+		}
+	}
+	else if (type == OperandType::ot_memory)
+	{
+		// Otherwise lanes write to addresses of their own, one at a time.
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			if (mask.value[lane])
+			{
+				uint8_t* bytes = &m_memory[address.value[lane] * laneCount + lane];
+				bytes[0] = static_cast<uint8_t>(value.value[lane]);
+
+				if (bWord)
+				{
+					bytes[laneCount] = static_cast<uint8_t>(value.value[lane] >> 8);
+				}
+			}
+		}
+	}
+}
+
+// Like Simulator::SetFlags only records the operation, in the lanes of mask.
+template <size_t laneCount>
+void LockstepEngine<laneCount>::SetFlags(OpCode opCode, const Lanes& newVal, const Lanes& oldDestVal, const Lanes& sourceVal, const Lanes& mask)
+{
+	// All ones for add, which flips the carry comparison and the overflow sign test.
+	const uint16_t add = opCode == OpCode::op_add ? 0xffff : 0;
+
+	for (size_t lane{ 0 }; lane < laneCount; ++lane)
+	{
+		const uint16_t keep = static_cast<uint16_t>(~mask.value[lane]);
+		const uint16_t set = mask.value[lane];
+
+		m_lazyResult.value[lane] = static_cast<uint16_t>((m_lazyResult.value[lane] & keep) | (newVal.value[lane] & set));
+		m_lazyDest.value[lane] = static_cast<uint16_t>((m_lazyDest.value[lane] & keep) | (oldDestVal.value[lane] & set));
+		m_lazySource.value[lane] = static_cast<uint16_t>((m_lazySource.value[lane] & keep) | (sourceVal.value[lane] & set));
+		m_lazyAdd.value[lane] = static_cast<uint16_t>((m_lazyAdd.value[lane] & keep) | (add & set));
+		m_lazyPending.value[lane] |= set;
+	}
+}
+
+// Mirrors Simulator::ComputeFlag for the six arithmetic flags, in every lane with an operation recorded.
+template <size_t laneCount>
+void LockstepEngine<laneCount>::ComputeFlags()
+{
+	uint16_t pending = 0;
+	for (size_t lane{ 0 }; lane < laneCount; ++lane)
+	{
+		pending |= m_lazyPending.value[lane];
+	}
+
+	if (!pending)
+	{
+		return;
+	}
+
+	uint16_t* carry = m_flags[0].value;
+	uint16_t* parity = m_flags[2].value;
+	uint16_t* auxiliary = m_flags[4].value;
+	uint16_t* zero = m_flags[6].value;
+	uint16_t* sign = m_flags[7].value;
+	uint16_t* overflow = m_flags[11].value;
+
+	for (size_t lane{ 0 }; lane < laneCount; ++lane)
+	{
+		const uint16_t result = m_lazyResult.value[lane];
+		const uint16_t dest = m_lazyDest.value[lane];
+		const uint16_t source = m_lazySource.value[lane];
+		const uint16_t add = m_lazyAdd.value[lane];
+		const uint16_t keep = static_cast<uint16_t>(~m_lazyPending.value[lane]);
+		const uint16_t set = m_lazyPending.value[lane];
+
+		uint16_t bits = static_cast<uint16_t>(result ^ (result >> 4));
+		bits = static_cast<uint16_t>(bits ^ (bits >> 2));
+		bits = static_cast<uint16_t>(bits ^ (bits >> 1));
+
+		const uint16_t below = dest < result ? 0xffff : 0;
+		const uint16_t above = dest > result ? 0xffff : 0;
+		const uint16_t overflowed = static_cast<uint16_t>((dest ^ source ^ add) & (dest ^ result)) & 0x8000 ? 0xffff : 0;
+
+		carry[lane] = static_cast<uint16_t>((carry[lane] & keep) | (((above & add) | (below & ~add)) & set));
+		parity[lane] = static_cast<uint16_t>((parity[lane] & keep) | ((bits & 1) ? 0 : set));
+		auxiliary[lane] = static_cast<uint16_t>((auxiliary[lane] & keep) | (((dest ^ source ^ result) & 0x10) ? set : 0));
+		zero[lane] = static_cast<uint16_t>((zero[lane] & keep) | (result == 0 ? set : 0));
+		sign[lane] = static_cast<uint16_t>((sign[lane] & keep) | ((result & 0x8000) ? set : 0));
+		overflow[lane] = static_cast<uint16_t>((overflow[lane] & keep) | (overflowed & set));
+		m_lazyPending.value[lane] = 0;
+	}
+}
+
+// Mirrors Simulator::BranchTaken, every lane at once. Loops only count cx down in the lanes of mask.
+template <size_t laneCount>
+void LockstepEngine<laneCount>::BranchTaken(OpCode opCode, const Lanes& mask, Lanes& taken)
+{
+	ComputeFlags();
+
+	const uint16_t* bit1 = m_flags[1].value;
+	const uint16_t* parity = m_flags[2].value;
+	const uint16_t* zero = m_flags[6].value;
+	const uint16_t* sign = m_flags[7].value;
+	const uint16_t* overflow = m_flags[11].value;
+	uint16_t* cx = m_registers[1].value;
+
+	// One loop per condition, so the opcode isn't looked at once per lane.
+	const auto forLanes = [&mask, &taken](auto condition)
+	{
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			taken.value[lane] = static_cast<uint16_t>(condition(lane) & mask.value[lane]);
+		}
+	};
+
+	const auto counted = [&mask, cx](size_t lane)
+	{
+		cx[lane] = static_cast<uint16_t>(cx[lane] - (mask.value[lane] & 1));
+	};
+
+	switch (opCode)
+	{
+	case OpCode::op_je:
+		forLanes([=](size_t lane) { return zero[lane]; });
+		break;
+	case OpCode::op_jl:
+	case OpCode::op_js:
+	case OpCode::op_jns:
+		forLanes([=](size_t lane) { return sign[lane]; });
+		break;
+	case OpCode::op_jle:
+		forLanes([=](size_t lane) { return zero[lane] | sign[lane]; });
+		break;
+	case OpCode::op_jb:
+		forLanes([=](size_t lane) { return bit1[lane]; });
+		break;
+	case OpCode::op_jbe:
+		forLanes([=](size_t lane) { return bit1[lane] | zero[lane]; });
+		break;
+	case OpCode::op_jp:
+		forLanes([=](size_t lane) { return parity[lane]; });
+		break;
+	case OpCode::op_jo:
+	case OpCode::op_jno:
+		forLanes([=](size_t lane) { return ~overflow[lane]; });
+		break;
+	case OpCode::op_jne:
+		forLanes([=](size_t lane) { return ~zero[lane]; });
+		break;
+	case OpCode::op_jnl:
+		forLanes([=](size_t lane) { return ~sign[lane]; });
+		break;
+	case OpCode::op_jnle:
+		forLanes([=](size_t lane) { return ~zero[lane] & sign[lane]; });
+		break;
+	case OpCode::op_jnb:
+		forLanes([=](size_t lane) { return ~bit1[lane]; });
+		break;
+	case OpCode::op_jnbe:
+		forLanes([=](size_t lane) { return ~bit1[lane] & ~zero[lane]; });
+		break;
+	case OpCode::op_jnp:
+		forLanes([=](size_t lane) { return ~parity[lane]; });
+		break;
+	case OpCode::op_loop:
+		forLanes([=](size_t lane) { return cx[lane] != 0 ? 0xffff : 0; });
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			cx[lane] = static_cast<uint16_t>(cx[lane] - (taken.value[lane] & 1));
+		}
+		break;
+	case OpCode::op_loopz:
+		forLanes([=](size_t lane) { counted(lane); return cx[lane] != 0 ? 0xffff : 0; });
+		break;
+	case OpCode::op_loopnz:
+		forLanes([=](size_t lane) { counted(lane); return cx[lane] != 0 ? ~zero[lane] : 0; });
+		break;
+	case OpCode::op_jcxz:
+		forLanes([=](size_t lane) { return cx[lane] == 0 ? 0xffff : 0; });
+		break;
+	default:
+		forLanes([](size_t) { return 0; });
+		break;
+	}
+}
+
+template <size_t laneCount>
+void LockstepEngine<laneCount>::AddMutatedRegister(size_t reg, const Lanes& mask)
+{
+	const uint8_t bit = static_cast<uint8_t>(1u << reg);
+
+	// Soon written in every lane, after which there's nothing left to do.
+	if (m_mutatedEverywhere & bit)
+	{
+		return;
+	}
+
+	uint8_t everywhere = 0xff;
+	for (size_t lane{ 0 }; lane < laneCount; ++lane)
+	{
+		if (mask.value[lane] && !(m_mutatedBits[lane] & bit))
+		{
+			m_mutatedBits[lane] |= bit;
+			m_mutatedRegisters[lane][m_mutatedCount[lane]++] = static_cast<uint8_t>(reg);
+		}
+
+		everywhere &= m_mutatedBits[lane];
+	}
+
+	m_mutatedEverywhere = everywhere;
+}
+
+// Run accounts for instructions, ip and the clocks that are the same in every lane.
+template <size_t laneCount>
+bool LockstepEngine<laneCount>::Execute(const LaneInstruction& instruction, const Lanes& mask)
+{
+	const DecodedInstruction& decodedInst = instruction.decodedInst;
+	const bool bWord = decodedInst.bWord;
+
+	if (decodedInst.DestOT == OperandType::ot_jumpTarget)
+	{
+		Lanes taken;
+		BranchTaken(decodedInst.opCode, mask, taken);
+
+		const uint32_t target = static_cast<uint32_t>(static_cast<int32_t>(decodedInst.destTarget));
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			const uint32_t active = mask.value[lane] & 1;
+			m_ip[lane] = active ? instruction.nextIp + (target & (0u - (taken.value[lane] & 1u))) : m_ip[lane];
+			m_clocks[lane] += active * (taken.value[lane] ? instruction.takenClocks : instruction.clocks);
+		}
+
+		return true;
+	}
+
+	// The memory operand's address in every lane, its odd address penalty only where it turns out odd.
+	Lanes address{};
+	const bool bMemory = decodedInst.DestOT == OperandType::ot_memory || decodedInst.SourceOT == OperandType::ot_memory;
+
+	if (bMemory && decodedInst.opCode != OpCode::op_undefined)
+	{
+		const EffectiveAddress& ea = decodedInst.DestOT == OperandType::ot_memory ? decodedInst.Dest.address : decodedInst.Source.address;
+		const Lanes* base = ea.base != Register::reg_none ? &m_registers[static_cast<size_t>(ea.base)] : nullptr;
+		const Lanes* index = ea.index != Register::reg_none ? &m_registers[static_cast<size_t>(ea.index)] : nullptr;
+
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			address.value[lane] = static_cast<uint16_t>(ea.displacement + (base ? base->value[lane] : 0) + (index ? index->value[lane] : 0));
+		}
+	}
+
+	if (bMemory && instruction.oddAddressPenalty > 0)
+	{
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			m_clocks[lane] += (mask.value[lane] & address.value[lane] & 1) * instruction.oddAddressPenalty;
+		}
+	}
+
+	if (decodedInst.opCode == OpCode::op_undefined)
+	{
+		return false;
+	}
+
+	if (decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator)
+	{
+		AddMutatedRegister(static_cast<size_t>(decodedInst.Dest.reg.index), mask);
+	}
+
+	const OpCode opCode = decodedInst.opCode;
+	if (opCode != OpCode::op_mov && opCode != OpCode::op_add && opCode != OpCode::op_sub && opCode != OpCode::op_cmp)
+	{
+		return false;
+	}
+
+	Lanes dest, source, result;
+	Read(decodedInst.Source, decodedInst.SourceOT, bWord, address, source);
+
+	if (opCode == OpCode::op_mov)
+	{
+		Write(decodedInst.Dest, decodedInst.DestOT, bWord, address, mask, source);
+		return false;
+	}
+
+	Read(decodedInst.Dest, decodedInst.DestOT, bWord, address, dest);
+
+	const uint16_t width = bWord ? 0xffff : 0xff;
+	for (size_t lane{ 0 }; lane < laneCount; ++lane)
+	{
+		const uint16_t sum = static_cast<uint16_t>(dest.value[lane] + source.value[lane]);
+		const uint16_t difference = static_cast<uint16_t>(dest.value[lane] - source.value[lane]);
+		result.value[lane] = static_cast<uint16_t>((opCode == OpCode::op_add ? sum : difference) & width);
+	}
+
+	// Like Simulator::Arithmetic, word cmp only sets flags and byte cmp also writes the difference, whose
+	// flags then come from subtracting the source a second time.
+	if (opCode != OpCode::op_cmp || !bWord)
+	{
+		Write(decodedInst.Dest, decodedInst.DestOT, bWord, address, mask, result);
+	}
+
+	if (opCode == OpCode::op_cmp && !bWord)
+	{
+		for (size_t lane{ 0 }; lane < laneCount; ++lane)
+		{
+			result.value[lane] = static_cast<uint16_t>(result.value[lane] - source.value[lane]);
+		}
+	}
+
+	SetFlags(opCode, result, dest, source, mask);
+
+	return false;
+}
+
+template <size_t laneCount>
+TraceBin::TraceFooter LockstepEngine<laneCount>::LaneState(size_t lane) const
+{
+	TraceBin::TraceFooter state{};
+	for (size_t reg{ 0 }; reg < 8; ++reg)
+	{
+		state.registers[reg] = m_registers[reg].value[lane];
+	}
+
+	state.mutatedCount = m_mutatedCount[lane];
+	std::copy(m_mutatedRegisters[lane], m_mutatedRegisters[lane] + m_mutatedCount[lane], state.mutatedRegisters);
+
+	for (size_t bit{ 0 }; bit < 16; ++bit)
+	{
+		state.flags |= static_cast<uint16_t>((m_flags[bit].value[lane] & 1) << bit);
+	}
+
+	state.ip = m_ip[lane];
+
+	return state;
+}
+
+template <size_t laneCount>
+int64_t LockstepEngine<laneCount>::LaneClocks(size_t lane) const
+{
+	return m_clocks[lane];
+}
+
+template <size_t laneCount>
+uint64_t LockstepEngine<laneCount>::LaneInstructions(size_t lane) const
+{
+	return m_laneInstructions[lane];
+}
+
+template class LockstepEngine<8>;
+template class LockstepEngine<16>;
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "sim8086_decoder.h"
+#include "sim8086_tracebin.h"
+
+// Runs laneCount copies of one program side by side on a single thread, for sweeps over initial register values.
+// State is kept as structure of arrays: a register, a flag or the ip is laneCount values next to each other, and a
+// flag is a lane mask, 0xffff where it is set. Every instruction is carried out for all lanes at once by loops over
+// the lanes that the compiler turns into SSE2, or AVX2 when built for a host that has it (SIM8086_NATIVE).
+// Once branches send lanes different ways, the lanes at the lowest ip run masked while the others wait, straight
+// through the block there until they meet the next lanes or branch. Results are what -exec would give for each
+// lane on its own.
+template <size_t laneCount>
+class LockstepEngine
+{
+public:
+	// program is followed by at least ProgramImage::padding zero bytes, like a loaded program.
+	LockstepEngine(const uint8_t* program, size_t programSize, Estimator::CpuTarget cpuTarget);
+
+	// Value reg starts with in lane. Shows as mutated like a register an instruction wrote.
+	void SetRegister(size_t lane, Register reg, uint16_t value);
+
+	// Executes until every lane has left the program, or until instructionsIssued reaches instructionLimit.
+	void Run();
+
+	// What the final register block shows of lane.
+	TraceBin::TraceFooter LaneState(size_t lane) const;
+
+	int64_t LaneClocks(size_t lane) const;
+	uint64_t LaneInstructions(size_t lane) const;
+
+	// Instructions executed, each once for all the lanes at its ip.
+	uint64_t instructionsIssued = 0;
+	uint64_t instructionLimit = UINT64_MAX;
+
+private:
+	// A register, flag or operand of every lane.
+	struct alignas(32) Lanes
+	{
+		uint16_t value[laneCount];
+	};
+
+	// An instruction and its clocks, the bus penalty included.
+	struct LaneInstruction
+	{
+		DecodedInstruction decodedInst{};
+		uint32_t ip = 0;
+		uint32_t nextIp = 0;
+		int32_t clocks = 0;
+		int32_t takenClocks = 0;
+		int32_t oddAddressPenalty = 0;
+	};
+
+	// Straight line code up to and including a branch, decoded the first time any lane gets to its start. Blocks
+	// end where the BlockEngine's do.
+	struct LaneBlock
+	{
+		std::vector<LaneInstruction> instructions{};
+	};
+
+	const LaneBlock& GetBlock(uint32_t ip);
+
+	// Returns whether the instruction was a branch, which moves the lanes of mask to where it goes.
+	bool Execute(const LaneInstruction& instruction, const Lanes& mask);
+
+	void Read(const Operand& operand, OperandType type, bool bWord, const Lanes& address, Lanes& value) const;
+	void Write(const Operand& operand, OperandType type, bool bWord, const Lanes& address, const Lanes& mask, const Lanes& value);
+	void SetFlags(OpCode opCode, const Lanes& newVal, const Lanes& oldDestVal, const Lanes& sourceVal, const Lanes& mask);
+	void ComputeFlags();
+	void BranchTaken(OpCode opCode, const Lanes& mask, Lanes& taken);
+	void AddMutatedRegister(size_t reg, const Lanes& mask);
+
+	const uint8_t* m_program = nullptr;
+	size_t m_programSize = 0;
+	Estimator::CpuTarget m_cpuTarget{};
+
+	// By start ip.
+	std::vector<std::unique_ptr<LaneBlock>> m_blocks{};
+
+	Lanes m_registers[8]{};
+	Lanes m_flags[16]{};
+
+	// The last arithmetic operation in every lane its flags are still pending for, see SetFlags.
+	Lanes m_lazyResult{};
+	Lanes m_lazyDest{};
+	Lanes m_lazySource{};
+	Lanes m_lazyAdd{};
+	Lanes m_lazyPending{};
+	uint32_t m_ip[laneCount]{};
+
+	// Effective addresses wrap at 64K, a word at 0xffff reaches one byte further.
+	static constexpr size_t addressableBytes = 0x10001;
+
+	// Byte address * laneCount + lane, so a direct address is read for all lanes in one go.
+	std::vector<uint8_t> m_memory{};
+
+	int64_t m_clocks[laneCount]{};
+	uint64_t m_laneInstructions[laneCount]{};
+
+	// Registers in the order they were first written, and a bit for each of them.
+	uint8_t m_mutatedRegisters[laneCount][8]{};
+	uint8_t m_mutatedCount[laneCount]{};
+	uint8_t m_mutatedBits[laneCount]{};
+	uint8_t m_mutatedEverywhere = 0;
+};
+
+extern template class LockstepEngine<8>;
+extern template class LockstepEngine<16>;
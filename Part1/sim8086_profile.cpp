@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "sim8086_decoder.h"
+#include "sim8086_profile.h"
+
+static bool IsBranch(OpCode opCode)
+{
+	return opCode >= OpCode::op_je && opCode <= OpCode::op_jcxz;
+}
+
+Profiler::Profiler(const VirtualChip& chip)
+	: m_chip(chip)
+	, m_counters(chip.m_programSize)
+	, m_sizes(chip.m_programSize)
+	, m_blockStarts(chip.m_programSize)
+{
+	if (!m_blockStarts.empty())
+	{
+		m_blockStarts[0] = true;
+	}
+}
+
+void Profiler::Count(const DecodedInstruction& decodedInst, uint32_t ip, int32_t clocks, int32_t eaClocks)
+{
+	Counters& counters = m_counters[ip];
+
+	if (counters.executions == 0)
+	{
+		const uint32_t size = static_cast<uint32_t>(decodedInst.extraBits + 1);
+		m_sizes[ip] = static_cast<uint8_t>(size);
+
+		if (IsBranch(decodedInst.opCode))
+		{
+			const uint32_t nextIp = ip + size;
+			const uint32_t targetIp = nextIp + decodedInst.destTarget;
+
+			for (uint32_t leader : { nextIp, targetIp })
+			{
+				if (leader < m_blockStarts.size())
+				{
+					m_blockStarts[leader] = true;
+				}
+			}
+		}
+	}
+
+	++counters.executions;
+	counters.clocks += static_cast<uint64_t>(clocks);
+	counters.eaClocks += static_cast<uint64_t>(eaClocks);
+}
+
+std::vector<Profiler::BlockProfile> Profiler::Blocks() const
+{
+	std::vector<BlockProfile> blocks{};
+	uint32_t expectedIp = UINT32_MAX;
+
+	for (uint32_t ip = 0; ip < m_counters.size(); ++ip)
+	{
+		const Counters& counters = m_counters[ip];
+		if (counters.executions == 0)
+		{
+			continue;
+		}
+
+		if (blocks.empty() || m_blockStarts[ip] || ip != expectedIp)
+		{
+			blocks.push_back({ ip, ip, counters });
+		}
+		else
+		{
+			blocks.back().counters.clocks += counters.clocks;
+			blocks.back().counters.eaClocks += counters.eaClocks;
+		}
+
+		expectedIp = ip + m_sizes[ip];
+		blocks.back().endIp = expectedIp;
+	}
+
+	return blocks;
+}
+
+std::string Profiler::Disassembly(uint32_t ip) const
+{
+	DecodedInstruction decodedInst;
+	Decoder::Disasm(m_chip, ip, decodedInst);
+
+	std::ostringstream text{};
+	text << decodedInst;
+
+	return text.str();
+}
+
+uint64_t Profiler::TotalClocks() const
+{
+	uint64_t total = 0;
+	for (const Counters& counters : m_counters)
+	{
+		total += counters.clocks;
+	}
+
+	return total;
+}
+
+void Profiler::WriteReport(std::ostream& out, size_t top) const
+{
+	const uint64_t totalClocks = TotalClocks();
+	const auto Share = [totalClocks](uint64_t clocks) { return totalClocks ? 100.0 * static_cast<double>(clocks) / static_cast<double>(totalClocks) : 0.0; };
+
+	std::vector<uint32_t> ips{};
+	for (uint32_t ip = 0; ip < m_counters.size(); ++ip)
+	{
+		if (m_counters[ip].executions > 0)
+		{
+			ips.push_back(ip);
+		}
+	}
+
+	std::stable_sort(ips.begin(), ips.end(), [this](uint32_t a, uint32_t b) { return m_counters[a].clocks > m_counters[b].clocks; });
+
+	out << "\nHotspots by instruction, " << totalClocks << " clocks:\n";
+	out << "      ip   executions       clocks    ea clocks  share  instruction\n";
+
+	for (size_t i{ 0 }; i < ips.size() && i < top; ++i)
+	{
+		const Counters& counters = m_counters[ips[i]];
+		out << "  0x" << std::hex << std::setw(4) << std::setfill('0') << ips[i] << std::dec << std::setfill(' ') <<
+			std::setw(13) << counters.executions << std::setw(13) << counters.clocks << std::setw(13) << counters.eaClocks <<
+			std::setw(6) << std::fixed << std::setprecision(1) << Share(counters.clocks) << "%  " << Disassembly(ips[i]) << '\n';
+	}
+
+	std::vector<BlockProfile> blocks = Blocks();
+	std::stable_sort(blocks.begin(), blocks.end(), [](const BlockProfile& a, const BlockProfile& b) { return a.counters.clocks > b.counters.clocks; });
+
+	out << "\nHotspots by block:\n";
+	out << "           ips   executions       clocks    ea clocks  share\n";
+
+	for (size_t i{ 0 }; i < blocks.size() && i < top; ++i)
+	{
+		const BlockProfile& block = blocks[i];
+		out << "  0x" << std::hex << std::setw(4) << std::setfill('0') << block.startIp << "-0x" << std::setw(4) << block.endIp <<
+			std::dec << std::setfill(' ') << std::setw(13) << block.counters.executions << std::setw(13) << block.counters.clocks <<
+			std::setw(13) << block.counters.eaClocks << std::setw(6) << std::fixed << std::setprecision(1) << Share(block.counters.clocks) << "%\n";
+
+		for (uint32_t ip = block.startIp; ip < block.endIp; ip += std::max<uint8_t>(m_sizes[ip], 1))
+		{
+			out << "        " << Disassembly(ip) << '\n';
+		}
+	}
+}
+
+void Profiler::WriteCsv(std::ostream& out) const
+{
+	out << "ip,block,executions,clocks,ea_clocks,instruction\n";
+
+	for (const BlockProfile& block : Blocks())
+	{
+		for (uint32_t ip = block.startIp; ip < block.endIp; ip += std::max<uint8_t>(m_sizes[ip], 1))
+		{
+			const Counters& counters = m_counters[ip];
+			out << ip << ',' << block.startIp << ',' << counters.executions << ',' << counters.clocks << ',' <<
+				counters.eaClocks << ",\"" << Disassembly(ip) << "\"\n";
+		}
+	}
+}
+
+void Profiler::WriteFolded(std::ostream& out, const std::string& programName) const
+{
+	for (const BlockProfile& block : Blocks())
+	{
+		std::ostringstream blockName{};
+		blockName << "block_0x" << std::hex << std::setw(4) << std::setfill('0') << block.startIp;
+
+		for (uint32_t ip = block.startIp; ip < block.endIp; ip += std::max<uint8_t>(m_sizes[ip], 1))
+		{
+			if (m_counters[ip].clocks == 0)
+			{
+				continue;
+			}
+
+			// Frames are separated by ';', which instruction text never contains.
+			out << programName << ';' << blockName.str() << ';' << Disassembly(ip) << ' ' << m_counters[ip].clocks << '\n';
+		}
+	}
+}
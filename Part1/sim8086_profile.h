@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct DecodedInstruction;
+struct VirtualChip;
+
+// Counts executions and clocks per instruction address while the stepping simulator runs, for -profile.
+// Blocks are worked out afterwards from what ran: a block starts at ip 0, at a branch target, after a branch
+// and wherever execution didn't flow in straight from the instruction before.
+class Profiler
+{
+public:
+	// Construct once the program is loaded into chip.
+	explicit Profiler(const VirtualChip& chip);
+
+	// One execution of decodedInst at ip. clocks is everything it cost, eaClocks the part of that spent on the
+	// effective address.
+	void Count(const DecodedInstruction& decodedInst, uint32_t ip, int32_t clocks, int32_t eaClocks);
+
+	// Instructions and blocks sorted by clocks, at most top of each, with their disassembly.
+	void WriteReport(std::ostream& out, size_t top) const;
+
+	// One line per executed instruction: ip,block,executions,clocks,ea_clocks,instruction.
+	void WriteCsv(std::ostream& out) const;
+
+	// Folded stacks for flamegraph tools: program;block;instruction clocks.
+	void WriteFolded(std::ostream& out, const std::string& programName) const;
+
+private:
+	struct Counters
+	{
+		uint64_t executions = 0;
+		uint64_t clocks = 0;
+		uint64_t eaClocks = 0;
+	};
+
+	struct BlockProfile
+	{
+		uint32_t startIp = 0;
+		uint32_t endIp = 0;
+		// Executions of the first instruction, clocks of all of them.
+		Counters counters{};
+	};
+
+	std::vector<BlockProfile> Blocks() const;
+	std::string Disassembly(uint32_t ip) const;
+	uint64_t TotalClocks() const;
+
+	const VirtualChip& m_chip;
+	std::vector<Counters> m_counters{};
+	// Size of the instruction at ip once it ran.
+	std::vector<uint8_t> m_sizes{};
+	std::vector<bool> m_blockStarts{};
+};
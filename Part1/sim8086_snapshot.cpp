@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <cstring>
+
+#include "sim8086.h"
+#include "sim8086_snapshot.h"
+
+void ChipSnapshot::Capture(VirtualChip& chip)
+{
+	m_memory = chip.m_memory;
+	m_registers = chip.m_registers;
+
+	m_flags = chip.m_flags;
+	m_lazyFlags = chip.m_lazyFlags;
+
+	m_ip = chip.ip_register;
+	m_totalClocks = chip.totalClocks;
+
+	std::fill(chip.m_dirtyPages.begin(), chip.m_dirtyPages.end(), uint8_t{ 0 });
+}
+
+void ChipSnapshot::Restore(VirtualChip& chip)
+{
+	constexpr size_t pageSize = size_t{ 1 } << VirtualChip::pageShift;
+
+	restoredPages = 0;
+
+	for (size_t page = 0; page < VirtualChip::pageCount; ++page)
+	{
+		if (chip.m_dirtyPages[page])
+		{
+			std::memcpy(chip.m_memory.data() + page * pageSize, m_memory.data() + page * pageSize, pageSize);
+			chip.m_dirtyPages[page] = 0;
+			++restoredPages;
+		}
+	}
+
+	chip.m_registers = m_registers;
+
+	chip.m_flags = m_flags;
+	chip.m_lazyFlags = m_lazyFlags;
+
+	chip.ip_register = m_ip;
+	chip.totalClocks = m_totalClocks;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#include "sim8086_decoder.h"
+
+// State of a chip to go back to, for running the same program from the same start over and over.
+// Only the memory pages written since Capture or the last Restore are copied back, which is what
+// VirtualChip::m_dirtyPages tracks. Since a chip has only one such map, restoring is only exact for the
+// snapshot captured from it last.
+class ChipSnapshot
+{
+public:
+	// Saves registers, flags, ip, totalClocks and memory, and starts tracking writes from here.
+	void Capture(VirtualChip& chip);
+
+	// Puts chip back the way Capture found it. Registers and memory keep their storage, so
+	// whatever was bound to them, like compiled blocks, stays valid.
+	void Restore(VirtualChip& chip);
+
+	// Pages the last Restore copied back.
+	size_t restoredPages = 0;
+
+private:
+	std::vector<uint8_t> m_memory{};
+	RegisterFile m_registers{};
+
+	std::bitset<16> m_flags{};
+	LazyFlags m_lazyFlags{};
+
+	uint32_t m_ip = 0;
+	int64_t m_totalClocks = 0;
+};
@@ -1,9 +1,239 @@
 #include "sim8086_text.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <iomanip>
+#include <sstream>
 
-template <typename T>
-void TextSpace::PrintHex(int w, T t)
+#include "sim8086.h"
+#include "sim8086_decoder.h"
+
+TextSpace::TraceWriter::TraceWriter()
+	: TraceWriter(std::cout)
+{
+}
+
+TextSpace::TraceWriter::TraceWriter(std::ostream& out)
+	: m_out(out)
+	, m_buffer(std::make_unique<char[]>(capacity))
+{
+}
+
+TextSpace::TraceWriter::~TraceWriter()
+{
+	Flush();
+}
+
+void TextSpace::TraceWriter::Write(std::string_view text)
 {
-	std::cout << "0x" << std::hex << std::setfill('0') << std::setw(w) << t << std::dec;
-}
\ No newline at end of file
+	if (text.size() > capacity)
+	{
+		Flush();
+		m_out.write(text.data(), static_cast<std::streamsize>(text.size()));
+		return;
+	}
+
+	std::memcpy(Reserve(text.size()), text.data(), text.size());
+	m_size += text.size();
+}
+
+void TextSpace::TraceWriter::Write(char c)
+{
+	*Reserve(1) = c;
+	++m_size;
+}
+
+void TextSpace::TraceWriter::Hex(int width, uint32_t value)
+{
+	char digits[8];
+	const char* end = std::to_chars(digits, digits + sizeof(digits), value, 16).ptr;
+	const size_t count = static_cast<size_t>(end - digits);
+	const size_t padding = width > static_cast<int>(count) ? static_cast<size_t>(width) - count : 0;
+
+	char* out = Reserve(2 + padding + count);
+	out[0] = '0';
+	out[1] = 'x';
+	std::memset(out + 2, '0', padding);
+	std::memcpy(out + 2 + padding, digits, count);
+	m_size += 2 + padding + count;
+}
+
+void TextSpace::TraceWriter::Decimal(int64_t value)
+{
+	char* out = Reserve(20);
+	m_size += static_cast<size_t>(std::to_chars(out, out + 20, value).ptr - out);
+}
+
+void TextSpace::TraceWriter::Flush()
+{
+	if (m_size > 0)
+	{
+		m_out.write(m_buffer.get(), static_cast<std::streamsize>(m_size));
+		m_size = 0;
+	}
+}
+
+static void WriteFlagSymbols(TextSpace::TraceWriter& out, uint16_t flags)
+{
+	for (size_t i{ 0 }; i < 16; ++i)
+	{
+		if (flags & (1 << i))
+		{
+			out.Write(VirtualChip::flagSymbols[i]);
+		}
+	}
+}
+
+const std::string& TextSpace::InstructionText(std::vector<std::string>& cache, uint32_t ip, const DecodedInstruction& decodedInst)
+{
+	std::string& text = cache[ip];
+	if (text.empty())
+	{
+		std::ostringstream textStream{};
+		textStream << decodedInst << " ; ";
+		text = textStream.str();
+	}
+
+	return text;
+}
+
+void TextSpace::WriteTraceLine(TraceWriter& out, std::string_view text, const TraceBin::TraceRecord& record, const TraceBin::TraceTotals& totals,
+	TraceBin::TraceMode mode, bool bBusModel)
+{
+	out.Write(text);
+
+	if (mode >= TraceBin::TraceMode::showClocks)
+	{
+		out.Write(" Clocks: +");
+		out.Decimal(record.clocks + record.eaClocks + record.penaltyClocks);
+		out.Write(" = ");
+		out.Decimal(totals.clocks);
+
+		if ((record.eaClocks > 0 || record.penaltyClocks > 0) && mode == TraceBin::TraceMode::explainClocks)
+		{
+			out.Write(" (");
+			out.Decimal(record.clocks);
+
+			if (record.eaClocks > 0)
+			{
+				out.Write(" + ");
+				out.Decimal(record.eaClocks);
+				out.Write("ea");
+			}
+
+			if (record.penaltyClocks > 0)
+			{
+				out.Write(" + ");
+				out.Decimal(record.penaltyClocks);
+				out.Write("p");
+			}
+
+			out.Write(")");
+		}
+
+		if (bBusModel)
+		{
+			out.Write(" BIU: +");
+			out.Decimal(record.busClocks);
+			out.Write(" = ");
+			out.Decimal(totals.busClocks);
+		}
+
+		out.Write(" | ");
+	}
+
+	const OpCode opCode = static_cast<OpCode>(record.opCode);
+
+	if (opCode == OpCode::op_loopnz)
+	{
+		out.Write("cx: ");
+		out.Hex(4, record.oldValue);
+		out.Write("->");
+		out.Hex(4, record.newValue);
+		out.Write(" ip:");
+	}
+	else if (record.reg == TraceBin::noRegister)
+	{
+		out.Write("ip:");
+	}
+	else
+	{
+		out.Write(Decoder::reg_rm_word[record.reg]);
+		out.Write(':');
+		out.Hex(4, record.oldValue);
+		out.Write("->");
+		out.Hex(4, record.newValue);
+		out.Write(" ip:");
+	}
+
+	// print ip register's old and new distance to starting pointer.
+	out.Hex(2, record.ip);
+	out.Write("->");
+	out.Hex(2, record.nextIp);
+
+	if (opCode == OpCode::op_add || opCode == OpCode::op_sub || opCode == OpCode::op_cmp)
+	{
+		out.Write(" flags:");
+		WriteFlagSymbols(out, record.oldFlags);
+		out.Write("->");
+		WriteFlagSymbols(out, record.newFlags);
+	}
+
+	out.Write('\n');
+}
+
+TraceBin::TraceFooter TextSpace::CurrentState(VirtualChip& chip)
+{
+	TraceBin::TraceFooter state{};
+	const RegisterFile& registers = chip.m_registers;
+	std::copy(registers.words, registers.words + 8, state.registers);
+	std::copy(registers.mutated, registers.mutated + registers.mutatedCount, state.mutatedRegisters);
+	state.mutatedCount = registers.mutatedCount;
+
+	state.flags = static_cast<uint16_t>(Simulator::GetFlags(chip).to_ulong());
+	state.ip = chip.ip_register;
+
+	return state;
+}
+
+void TextSpace::WriteFinalRegisters(TraceWriter& out, const TraceBin::TraceFooter& state, std::string_view heading)
+{
+	out.Write('\n');
+	out.Write(heading);
+	out.Write(":\n");
+
+	for (size_t i{ 0 }; i < state.mutatedCount; ++i)
+	{
+		const uint8_t reg = state.mutatedRegisters[i];
+		const int32_t Val = static_cast<int32_t>(state.registers[reg]);
+
+		if (Val == 0)
+		{
+			continue;
+		}
+
+		out.Write("      ");
+		out.Write(Decoder::reg_rm_word[reg]);
+		out.Write(": ");
+		out.Hex(4, state.registers[reg]);
+		out.Write(" (");
+		out.Decimal(Val);
+		out.Write(")\n");
+	}
+
+	const int32_t distance = static_cast<int32_t>(state.ip);
+
+	out.Write("      ip:");
+	out.Hex(4, state.ip);
+	out.Write(" (");
+	out.Decimal(distance);
+	out.Write(")");
+
+	if (state.flags != 0)
+	{
+		out.Write("\n  flags :");
+		WriteFlagSymbols(out, state.flags);
+	}
+
+	out.Write('\n');
+}
@@ -1,7 +1,73 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sim8086_tracebin.h"
+
+struct DecodedInstruction;
+struct VirtualChip;
+
 namespace TextSpace
 {
-	template <typename T>
-	void PrintHex(int w, T t);
-}
\ No newline at end of file
+	// Formats trace output into one large reusable buffer and hands it to std::cout, or the stream it was given, in big chunks.
+	// Nothing but the buffer itself is allocated, and stream state is never touched.
+	class TraceWriter
+	{
+	public:
+		TraceWriter();
+		explicit TraceWriter(std::ostream& out);
+		~TraceWriter();
+
+		TraceWriter(const TraceWriter&) = delete;
+		TraceWriter& operator=(const TraceWriter&) = delete;
+
+		void Write(std::string_view text);
+		void Write(char c);
+
+		// "0x" followed by at least width lowercase hex digits, like std::hex with std::setw and '0' fill.
+		void Hex(int width, uint32_t value);
+
+		void Decimal(int64_t value);
+
+		// Must be called before anything else writes to the stream.
+		void Flush();
+
+	private:
+		static constexpr size_t capacity = 1 << 20;
+
+		inline char* Reserve(size_t count)
+		{
+			if (m_size + count > capacity)
+			{
+				Flush();
+			}
+
+			return m_buffer.get() + m_size;
+		}
+
+		std::ostream& m_out;
+		std::unique_ptr<char[]> m_buffer;
+		size_t m_size = 0;
+	};
+
+	// Disassembly of the instruction at ip followed by " ; ", formatted into cache the first time ip is traced.
+	// cache has an entry per program byte.
+	const std::string& InstructionText(std::vector<std::string>& cache, uint32_t ip, const DecodedInstruction& decodedInst);
+
+	// One line of the -exec, -showclocks or -explainclocks trace. text is the instruction's disassembly followed by " ; ",
+	// totals the clocks up to and including the instruction. bBusModel adds the BusInterfaceUnit clocks next to the estimate.
+	void WriteTraceLine(TraceWriter& out, std::string_view text, const TraceBin::TraceRecord& record, const TraceBin::TraceTotals& totals,
+		TraceBin::TraceMode mode, bool bBusModel = false);
+
+	// What the final register block shows of chip as it is now.
+	TraceBin::TraceFooter CurrentState(VirtualChip& chip);
+
+	// The "Final registers:" block closing every simulation, or the same block for an earlier state under another heading.
+	void WriteFinalRegisters(TraceWriter& out, const TraceBin::TraceFooter& state, std::string_view heading = "Final registers");
+}
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstring>
+
+#include "sim8086.h"
+#include "sim8086_estimation.h"
+#include "sim8086_timetravel.h"
+
+// Effective addresses are 16 bit, the last byte of a word at 0xffff is the only thing written past them.
+static constexpr size_t writableSize = 0x10000 + 1;
+static constexpr size_t pageSize = size_t{ 1 } << VirtualChip::pageShift;
+static constexpr size_t writablePages = (writableSize + pageSize - 1) / pageSize;
+
+TimeTravel::TimeTravel(VirtualChip& chip, uint64_t checkpointInterval)
+	: m_chip(chip)
+	, m_checkpointInterval(std::max<uint64_t>(checkpointInterval, 1))
+{
+	m_decodeCache.Reset(m_chip.m_programSize);
+	m_undoLog.reserve(static_cast<size_t>(m_checkpointInterval));
+
+	SaveCheckpoint();
+}
+
+void TimeTravel::Record(const DecodedInstruction& decodedInst)
+{
+	if (m_position % m_checkpointInterval == 0)
+	{
+		if (m_position / m_checkpointInterval == m_checkpoints.size())
+		{
+			SaveCheckpoint();
+		}
+
+		m_undoLog.clear();
+		m_undoStart = m_position;
+	}
+
+	UndoEntry& entry = m_undoLog.emplace_back();
+	entry.ip = m_chip.ip_register;
+	entry.totalClocks = m_chip.totalClocks;
+	entry.lazyFlags = m_chip.m_lazyFlags;
+	entry.flags = static_cast<uint16_t>(m_chip.m_flags.to_ulong());
+	entry.mutatedCount = m_chip.m_registers.mutatedCount;
+
+	// Only a destination operand or the cx a loop counts down can change, undefined opcodes change nothing.
+	if (decodedInst.opCode == OpCode::op_undefined)
+	{
+		entry.target = UndoTarget::none;
+	}
+	else if (decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator)
+	{
+		entry.target = UndoTarget::reg;
+		entry.index = static_cast<uint32_t>(decodedInst.Dest.reg.index);
+	}
+	else if (decodedInst.DestOT == OperandType::ot_memory)
+	{
+		entry.target = UndoTarget::memory;
+		entry.index = Decoder::GetEffectiveAddressIndex(m_chip, decodedInst.Dest.address);
+	}
+	else if (decodedInst.opCode == OpCode::op_loop || decodedInst.opCode == OpCode::op_loopz || decodedInst.opCode == OpCode::op_loopnz)
+	{
+		entry.target = UndoTarget::reg;
+		entry.index = static_cast<uint32_t>(Register::reg_cx);
+	}
+
+	if (entry.target == UndoTarget::reg)
+	{
+		entry.oldValue = m_chip[static_cast<size_t>(entry.index)];
+	}
+	else if (entry.target == UndoTarget::memory)
+	{
+		std::memcpy(&entry.oldValue, &m_chip.m_memory[entry.index], sizeof(entry.oldValue));
+	}
+
+	++m_position;
+}
+
+bool TimeTravel::StepBack()
+{
+	if (m_position == 0)
+	{
+		return false;
+	}
+
+	if (m_position == m_undoStart)
+	{
+		return Seek(m_position - 1);
+	}
+
+	Undo(m_undoLog.back());
+	m_undoLog.pop_back();
+	--m_position;
+
+	return true;
+}
+
+bool TimeTravel::Seek(uint64_t position)
+{
+	const size_t checkpoint = static_cast<size_t>(std::min<uint64_t>(position / m_checkpointInterval, m_checkpoints.size() - 1));
+
+	// Undo when the target is in the current interval, else start from the closest checkpoint unless
+	// running on from here gets there sooner.
+	if (position >= m_undoStart && position < m_position)
+	{
+		while (m_position > position)
+		{
+			Undo(m_undoLog.back());
+			m_undoLog.pop_back();
+			--m_position;
+		}
+
+		return true;
+	}
+
+	if (position < m_position || checkpoint * m_checkpointInterval > m_position)
+	{
+		LoadCheckpoint(checkpoint);
+	}
+
+	while (m_position < position)
+	{
+		if (m_chip.ip_register >= m_chip.m_programSize)
+		{
+			return false;
+		}
+
+		DecodedInstruction decodedInst = m_decodeCache.Fetch(m_chip);
+		Record(decodedInst);
+
+		const bool bBranchTaken = Simulator::ExecuteInstruction(m_chip, decodedInst);
+
+		if (bCountClocks)
+		{
+			int32_t estimatedClocks = 0;
+			int32_t ea = 0;
+			Estimator::EstimateClocks(decodedInst, estimatedClocks, ea, bBranchTaken);
+
+			m_chip.totalClocks += estimatedClocks + ea + Estimator::TransferPenalty(m_chip, decodedInst);
+		}
+	}
+
+	return true;
+}
+
+void TimeTravel::SaveCheckpoint()
+{
+	const Checkpoint* previous = m_checkpoints.empty() ? nullptr : &m_checkpoints.back();
+
+	std::vector<std::shared_ptr<const std::vector<uint8_t>>> pages(writablePages);
+	for (size_t page = 0; page < writablePages; ++page)
+	{
+		const auto begin = m_chip.m_memory.begin() + page * pageSize;
+		if (previous && std::equal(begin, begin + pageSize, previous->pages[page]->begin()))
+		{
+			pages[page] = previous->pages[page];
+		}
+		else
+		{
+			pages[page] = std::make_shared<const std::vector<uint8_t>>(begin, begin + pageSize);
+		}
+	}
+
+	Checkpoint& checkpoint = m_checkpoints.emplace_back();
+	checkpoint.ip = m_chip.ip_register;
+	checkpoint.totalClocks = m_chip.totalClocks;
+	checkpoint.registers = m_chip.m_registers;
+	checkpoint.flags = m_chip.m_flags;
+	checkpoint.lazyFlags = m_chip.m_lazyFlags;
+	checkpoint.pages = std::move(pages);
+}
+
+void TimeTravel::LoadCheckpoint(size_t checkpoint)
+{
+	const Checkpoint& saved = m_checkpoints[checkpoint];
+	m_chip.ip_register = saved.ip;
+	m_chip.totalClocks = saved.totalClocks;
+	m_chip.m_registers = saved.registers;
+	m_chip.m_flags = saved.flags;
+	m_chip.m_lazyFlags = saved.lazyFlags;
+
+	// Only pages that differ are copied back, and marked dirty for ChipSnapshot.
+	for (size_t page = 0; page < writablePages; ++page)
+	{
+		uint8_t* memory = m_chip.m_memory.data() + page * pageSize;
+		const std::vector<uint8_t>& savedPage = *saved.pages[page];
+
+		if (std::memcmp(memory, savedPage.data(), pageSize) != 0)
+		{
+			std::memcpy(memory, savedPage.data(), pageSize);
+			m_chip.MarkDirty(page * pageSize, pageSize);
+		}
+	}
+
+	m_position = checkpoint * m_checkpointInterval;
+	m_undoStart = m_position;
+	m_undoLog.clear();
+}
+
+void TimeTravel::Undo(const UndoEntry& entry)
+{
+	m_chip.ip_register = entry.ip;
+	m_chip.totalClocks = entry.totalClocks;
+	m_chip.m_lazyFlags = entry.lazyFlags;
+	m_chip.m_flags = std::bitset<16>(entry.flags);
+	m_chip.m_registers.TruncateMutated(entry.mutatedCount);
+
+	if (entry.target == UndoTarget::reg)
+	{
+		m_chip[static_cast<size_t>(entry.index)] = entry.oldValue;
+	}
+	else if (entry.target == UndoTarget::memory)
+	{
+		std::memcpy(&m_chip.m_memory[entry.index], &entry.oldValue, sizeof(entry.oldValue));
+		m_chip.MarkDirty(entry.index, sizeof(entry.oldValue));
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "sim8086_decoder.h"
+
+// Lets the stepping simulator go back in time. Every checkpointInterval instructions the whole chip state is
+// saved, and every instruction in between logs what it's about to overwrite, so stepping back is undoing one
+// log entry and seeking anywhere is loading the checkpoint at or before the target and running forward from it.
+// The undo log only ever covers the current interval, which keeps it small however long the run is.
+class TimeTravel
+{
+public:
+	// Construct once the program is loaded into chip, its state at that point is instruction 0.
+	explicit TimeTravel(VirtualChip& chip, uint64_t checkpointInterval = defaultCheckpointInterval);
+
+	// Call right before decodedInst executes at chip.ip_register.
+	void Record(const DecodedInstruction& decodedInst);
+
+	// Undoes the last instruction. False at instruction 0.
+	bool StepBack();
+
+	// Moves to the state right before instruction position executes, running the program as far as needed.
+	// False when the program ends before reaching it, which leaves the chip at the end.
+	bool Seek(uint64_t position);
+
+	// Instructions executed to get to the current state.
+	uint64_t Position() const
+	{
+		return m_position;
+	}
+
+	// Adds the estimated clocks of every instruction replayed to totalClocks, like -showclocks does.
+	bool bCountClocks = false;
+
+	static constexpr uint64_t defaultCheckpointInterval = 4096;
+
+private:
+	struct Checkpoint
+	{
+		uint32_t ip = 0;
+		int64_t totalClocks = 0;
+		RegisterFile registers{};
+		std::bitset<16> flags{};
+		LazyFlags lazyFlags{};
+
+		// Writable memory by page. Pages that didn't change since the checkpoint before are shared with it.
+		std::vector<std::shared_ptr<const std::vector<uint8_t>>> pages{};
+	};
+
+	enum class UndoTarget : uint8_t
+	{
+		none,
+		reg,
+		memory
+	};
+
+	// What one instruction changes: ip, clocks, flags, the mutated register list, and at most one
+	// register or memory word.
+	struct UndoEntry
+	{
+		uint32_t ip = 0;
+		int64_t totalClocks = 0;
+		uint32_t index = 0;
+		LazyFlags lazyFlags{};
+		uint16_t flags = 0;
+		uint16_t oldValue = 0;
+		UndoTarget target = UndoTarget::none;
+		uint8_t mutatedCount = 0;
+	};
+
+	void SaveCheckpoint();
+	void LoadCheckpoint(size_t checkpoint);
+	void Undo(const UndoEntry& entry);
+
+	VirtualChip& m_chip;
+	uint64_t m_checkpointInterval = defaultCheckpointInterval;
+
+	// m_checkpoints[i] is the state before instruction i * m_checkpointInterval.
+	std::vector<Checkpoint> m_checkpoints{};
+
+	// Entries for the instructions from m_undoStart up to m_position.
+	std::vector<UndoEntry> m_undoLog{};
+	uint64_t m_undoStart = 0;
+
+	uint64_t m_position = 0;
+
+	DecodeCache m_decodeCache{};
+};
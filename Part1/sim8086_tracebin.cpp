@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "sim8086_tracebin.h"
+
+bool TraceBin::TraceFileWriter::Open(const char* filePath, const std::string& programName, TraceMode mode, bool bBusModel, const uint8_t* program, uint32_t programSize)
+{
+	m_file.open(filePath, std::ios::binary);
+	if (!m_file)
+	{
+		return false;
+	}
+
+	TraceHeader header{};
+	header.recordSize = sizeof(TraceRecord);
+	header.nameSize = static_cast<uint32_t>(programName.size());
+	header.programSize = programSize;
+	header.indexInterval = indexInterval;
+	header.mode = mode;
+	header.bBusModel = bBusModel;
+
+	m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_file.write(programName.data(), static_cast<std::streamsize>(programName.size()));
+	m_file.write(reinterpret_cast<const char*>(program), programSize);
+
+	m_records.reserve(chunkRecords);
+
+	return static_cast<bool>(m_file);
+}
+
+void TraceBin::TraceFileWriter::Flush()
+{
+	m_file.write(reinterpret_cast<const char*>(m_records.data()), static_cast<std::streamsize>(m_records.size() * sizeof(TraceRecord)));
+	m_records.clear();
+}
+
+bool TraceBin::TraceFileWriter::Close(const TraceFooter& footer)
+{
+	Flush();
+	m_file.write(reinterpret_cast<const char*>(m_index.data()), static_cast<std::streamsize>(m_index.size() * sizeof(TraceTotals)));
+	m_file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+	m_file.seekp(offsetof(TraceHeader, recordCount));
+	m_file.write(reinterpret_cast<const char*>(&m_recordCount), sizeof(m_recordCount));
+	m_file.close();
+
+	return static_cast<bool>(m_file);
+}
+
+bool TraceBin::TraceFileReader::Open(const char* filePath)
+{
+	if (!m_image.Open(filePath) || m_image.Size() < sizeof(TraceHeader) + sizeof(TraceFooter))
+	{
+		return false;
+	}
+
+	std::memcpy(&m_header, m_image.Data(), sizeof(TraceHeader));
+	if (std::memcmp(m_header.magic, TraceHeader{}.magic, sizeof(m_header.magic)) != 0 || m_header.recordSize != sizeof(TraceRecord) ||
+		m_header.indexInterval == 0)
+	{
+		return false;
+	}
+
+	m_recordCount = m_header.recordCount;
+	m_recordsOffset = sizeof(TraceHeader) + m_header.nameSize + m_header.programSize;
+	m_indexOffset = m_recordsOffset + m_recordCount * sizeof(TraceRecord);
+
+	const uint64_t indexEntries = (m_recordCount + m_header.indexInterval - 1) / m_header.indexInterval;
+	if (m_image.Size() != m_indexOffset + indexEntries * sizeof(TraceTotals) + sizeof(TraceFooter))
+	{
+		return false;
+	}
+	std::memcpy(&m_footer, m_image.Data() + m_image.Size() - sizeof(TraceFooter), sizeof(TraceFooter));
+
+	return true;
+}
+
+std::string TraceBin::TraceFileReader::ProgramName() const
+{
+	return std::string(reinterpret_cast<const char*>(m_image.Data()) + sizeof(TraceHeader), m_header.nameSize);
+}
+
+const uint8_t* TraceBin::TraceFileReader::Program() const
+{
+	return m_image.Data() + sizeof(TraceHeader) + m_header.nameSize;
+}
+
+TraceBin::TraceRecord TraceBin::TraceFileReader::Record(uint64_t index) const
+{
+	TraceRecord record{};
+	std::memcpy(&record, m_image.Data() + m_recordsOffset + index * sizeof(TraceRecord), sizeof(TraceRecord));
+
+	return record;
+}
+
+TraceBin::TraceTotals TraceBin::TraceFileReader::TotalsBefore(uint64_t index) const
+{
+	TraceTotals totals{};
+	if (m_recordCount == 0)
+	{
+		return totals;
+	}
+
+	uint64_t entry = std::min(index, m_recordCount) / m_header.indexInterval;
+	entry = std::min(entry, (m_recordCount - 1) / m_header.indexInterval);
+	std::memcpy(&totals, m_image.Data() + m_indexOffset + entry * sizeof(TraceTotals), sizeof(TraceTotals));
+
+	for (uint64_t i{ entry * m_header.indexInterval }; i < std::min(index, m_recordCount); ++i)
+	{
+		totals.Add(Record(i));
+	}
+
+	return totals;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "sim8086_loader.h"
+
+// Binary execution trace written by -trace-bin and rendered by sim8086_traceview.
+// Layout: TraceHeader, program name, program bytes, one TraceRecord per executed instruction, the TraceTotals index,
+// TraceFooter. Records have a fixed size so record n can be read without touching the ones before it. They only hold
+// the clocks of their own instruction, the running totals come from adding them up from the nearest index entry.
+namespace TraceBin
+{
+	enum class TraceMode : uint8_t
+	{
+		exec,
+		showClocks,
+		explainClocks
+	};
+
+	struct TraceHeader
+	{
+		char magic[8]{ 'S', '8', '6', 'T', 'R', 'A', 'C', 'E' };
+		uint32_t recordSize = 0;
+		uint32_t nameSize = 0;
+		uint32_t programSize = 0;
+		// Records between two entries of the index.
+		uint32_t indexInterval = 0;
+		TraceMode mode = TraceMode::exec;
+		// Records carry BusInterfaceUnit timings, -biu.
+		uint8_t bBusModel = 0;
+		uint8_t reserved[6]{};
+		// Filled in when the writer is closed.
+		uint64_t recordCount = 0;
+	};
+
+	static_assert(sizeof(TraceHeader) == 40);
+
+	// Everything a trace line shows apart from the instruction text, which comes from decoding the program at ip.
+	struct TraceRecord
+	{
+		uint32_t ip = 0;
+		uint32_t nextIp = 0;
+
+		// Register the line reports, cx for loopnz. Only meaningful when reg != noRegister.
+		uint16_t oldValue = 0;
+		uint16_t newValue = 0;
+
+		uint16_t oldFlags = 0;
+		uint16_t newFlags = 0;
+
+		uint8_t clocks = 0;
+		uint8_t eaClocks = 0;
+		uint8_t opCode = 0;
+		uint8_t reg = 0;
+
+		// 8088 and odd address word transfers.
+		uint8_t penaltyClocks = 0;
+		uint8_t reserved = 0;
+
+		// What the BusInterfaceUnit model makes of it, only with -biu.
+		uint16_t busClocks = 0;
+	};
+
+	static_assert(sizeof(TraceRecord) == 24);
+
+	// Clocks up to and including an instruction, the running totals a trace line shows.
+	struct TraceTotals
+	{
+		int64_t clocks = 0;
+		int64_t busClocks = 0;
+
+		inline void Add(const TraceRecord& record)
+		{
+			clocks += record.clocks + record.eaClocks + record.penaltyClocks;
+			busClocks += record.busClocks;
+		}
+	};
+
+	// Records between index entries, each entry being the totals before the record it stands for.
+	constexpr uint32_t indexInterval = 4096;
+
+	constexpr uint8_t noRegister = 0xff;
+
+	// State behind the final register dump.
+	struct TraceFooter
+	{
+		uint16_t registers[8]{};
+		uint8_t mutatedRegisters[8]{};
+		uint8_t mutatedCount = 0;
+		uint8_t reserved = 0;
+		uint16_t flags = 0;
+		uint32_t ip = 0;
+	};
+
+	class TraceFileWriter
+	{
+	public:
+		bool Open(const char* filePath, const std::string& programName, TraceMode mode, bool bBusModel, const uint8_t* program, uint32_t programSize);
+
+		inline void Append(const TraceRecord& record)
+		{
+			if (m_recordCount % indexInterval == 0)
+			{
+				m_index.push_back(m_totals);
+			}
+
+			m_totals.Add(record);
+			++m_recordCount;
+
+			m_records.push_back(record);
+
+			if (m_records.size() == chunkRecords)
+			{
+				Flush();
+			}
+		}
+
+		// Writes the footer, nothing can be appended afterwards.
+		bool Close(const TraceFooter& footer);
+
+	private:
+		static constexpr size_t chunkRecords = 1 << 16;
+
+		void Flush();
+
+		std::ofstream m_file{};
+		std::vector<TraceRecord> m_records{};
+
+		std::vector<TraceTotals> m_index{};
+		TraceTotals m_totals{};
+		uint64_t m_recordCount = 0;
+	};
+
+	class TraceFileReader
+	{
+	public:
+		bool Open(const char* filePath);
+
+		const TraceHeader& Header() const
+		{
+			return m_header;
+		}
+
+		const TraceFooter& Footer() const
+		{
+			return m_footer;
+		}
+
+		std::string ProgramName() const;
+		const uint8_t* Program() const;
+
+		uint64_t RecordCount() const
+		{
+			return m_recordCount;
+		}
+
+		TraceRecord Record(uint64_t index) const;
+
+		// Totals before record index, from the index entry at or before it and the records in between.
+		TraceTotals TotalsBefore(uint64_t index) const;
+
+	private:
+		ProgramImage m_image{};
+
+		TraceHeader m_header{};
+		TraceFooter m_footer{};
+
+		size_t m_recordsOffset = 0;
+		size_t m_indexOffset = 0;
+		uint64_t m_recordCount = 0;
+	};
+}
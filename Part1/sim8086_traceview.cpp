@@ -0,0 +1,156 @@
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sim8086_decoder.h"
+#include "sim8086_loader.h"
+#include "sim8086_text.h"
+#include "sim8086_tracebin.h"
+
+// Renders a trace written by sim8086 -trace-bin. Without filters the output is exactly what sim8086 would have
+// printed in the same mode; with any of them only the matching trace lines are printed.
+//
+// usage: sim8086_traceview [-info] [-from N] [-count N] [-ip LOW[:HIGH]] [-op NAME] trace.bin
+
+static const char* ModeName(TraceBin::TraceMode mode)
+{
+    switch (mode)
+    {
+    case TraceBin::TraceMode::showClocks:
+        return "-showclocks";
+    case TraceBin::TraceMode::explainClocks:
+        return "-explainclocks";
+    default:
+        return "-exec";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: sim8086_traceview [-info] [-from N] [-count N] [-ip LOW[:HIGH]] [-op NAME] trace.bin\n";
+        return -1;
+    }
+
+    bool bInfo = false;
+    bool bFiltered = false;
+
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    uint32_t lowIp = 0;
+    uint32_t highIp = UINT32_MAX;
+    std::string opName{};
+
+    for (int i{ 1 }; i < argc - 1; ++i)
+    {
+        const std::string arg = std::string(argv[i]);
+        const bool bHasValue = i + 1 < argc - 1;
+
+        if (arg == "-info")
+        {
+            bInfo = true;
+        }
+        else if (arg == "-from" && bHasValue)
+        {
+            from = std::strtoull(argv[++i], nullptr, 0);
+            bFiltered = true;
+        }
+        else if (arg == "-count" && bHasValue)
+        {
+            count = std::strtoull(argv[++i], nullptr, 0);
+            bFiltered = true;
+        }
+        else if (arg == "-ip" && bHasValue)
+        {
+            char* end = nullptr;
+            lowIp = static_cast<uint32_t>(std::strtoul(argv[++i], &end, 0));
+            highIp = *end == ':' ? static_cast<uint32_t>(std::strtoul(end + 1, nullptr, 0)) : lowIp;
+            bFiltered = true;
+        }
+        else if (arg == "-op" && bHasValue)
+        {
+            opName = argv[++i];
+            bFiltered = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << '\n';
+            return -1;
+        }
+    }
+
+    TraceBin::TraceFileReader reader{};
+    if (!reader.Open(argv[argc - 1]))
+    {
+        std::cout << argv[argc - 1] << " is not a sim8086 binary trace!";
+        return -1;
+    }
+
+    const TraceBin::TraceHeader& header = reader.Header();
+
+    if (bInfo)
+    {
+        std::cout << "program: " << reader.ProgramName() << " (" << header.programSize << " bytes)\n" <<
+            "mode: " << ModeName(header.mode) << (header.bBusModel ? " -biu" : "") << "\nrecords: " << reader.RecordCount() << '\n';
+        return 0;
+    }
+
+    // Decoding a truncated last instruction reads past the program, which has to be zeros like it was when tracing.
+    std::vector<uint8_t> program(reader.Program(), reader.Program() + header.programSize);
+    program.resize(program.size() + ProgramImage::padding);
+
+    // Only decoded from, nothing runs.
+    VirtualChip chip{};
+    chip.m_program = program.data();
+    chip.m_programSize = header.programSize;
+
+    TextSpace::TraceWriter trace{};
+    std::vector<std::string> disassembly(header.programSize);
+
+    if (!bFiltered)
+    {
+        trace.Write(reader.ProgramName());
+        trace.Write(" execution \n");
+    }
+
+    const uint64_t end = count < reader.RecordCount() - std::min(from, reader.RecordCount()) ? from + count : reader.RecordCount();
+
+    // Records only hold their own clocks, the lines show running totals.
+    TraceBin::TraceTotals totals = reader.TotalsBefore(from);
+
+    for (uint64_t i{ from }; i < end; ++i)
+    {
+        const TraceBin::TraceRecord record = reader.Record(i);
+        totals.Add(record);
+
+        if (record.ip < lowIp || record.ip > highIp || record.ip >= header.programSize)
+        {
+            continue;
+        }
+
+        if (!opName.empty() && OpcodeToString(static_cast<OpCode>(record.opCode)) != opName)
+        {
+            continue;
+        }
+
+        DecodedInstruction decodedInst;
+        if (disassembly[record.ip].empty())
+        {
+            Decoder::Disasm(chip, record.ip, decodedInst);
+        }
+
+        TextSpace::WriteTraceLine(trace, TextSpace::InstructionText(disassembly, record.ip, decodedInst), record, totals, header.mode, header.bBusModel);
+    }
+
+    if (!bFiltered)
+    {
+        TextSpace::WriteFinalRegisters(trace, reader.Footer());
+    }
+
+    trace.Flush();
+
+    return 0;
+}
@@ -0,0 +1,475 @@
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <string>
+#include <sstream>
+
+#include "sim8086.h"
+#include "sim8086_blocks.h"
+#include "sim8086_decoder.h"
+#include "sim8086_jit.h"
+#include "sim8086_translate.h"
+
+// Runtime every translated program starts with. Mirrors Simulator::Arithmetic, SetFlags and BranchTaken,
+// including the way they read the flags, so the translated program ends up where -exec does.
+static const char* prelude = R"(#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	enum Operation { Mov, Add, Sub, Cmp };
+
+	// Bit positions match VirtualChip::m_flags. jb, jbe, jnb and jnbe read bit 1 like the simulator does.
+	constexpr uint16_t CF = 0x0001, BF = 0x0002, PF = 0x0004, AF = 0x0010, ZF = 0x0040, SF = 0x0080, OF = 0x0800;
+
+	const char* const registerNames[8] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di" };
+	const char flagSymbols[16] = { 'C', 0, 'P', 0, 'A', 0, 'Z', 'S', 'T', 'I', 'D', 'O', 0, 0, 0, 0 };
+
+	struct State
+	{
+		uint16_t reg[8]{};
+		uint16_t flags = 0;
+
+		// Registers in the order they were first written, for printing.
+		uint8_t mutated[8]{};
+		uint8_t mutatedCount = 0;
+	};
+
+	uint8_t memory[1 << 20];
+
+	inline void Mutate(State& s, uint8_t index)
+	{
+		for (uint8_t i = 0; i < s.mutatedCount; ++i)
+		{
+			if (s.mutated[i] == index)
+			{
+				return;
+			}
+		}
+
+		s.mutated[s.mutatedCount++] = index;
+	}
+
+	inline uint8_t& ByteRegister(State& s, int index, int offset)
+	{
+		return reinterpret_cast<uint8_t*>(&s.reg[index])[offset];
+	}
+
+	template <typename T>
+	inline T Load(uint32_t address)
+	{
+		T value;
+		std::memcpy(&value, &memory[address], sizeof(T));
+		return value;
+	}
+
+	inline void SetFlags(State& s, Operation op, uint16_t newVal, uint16_t oldDestVal, uint16_t sourceVal)
+	{
+		uint16_t flags = 0;
+		flags |= (op == Add ? oldDestVal > newVal : oldDestVal < newVal) ? CF : 0;
+		flags |= std::bitset<8>(static_cast<uint8_t>(newVal)).count() % 2 == 0 ? PF : 0;
+		flags |= ((oldDestVal ^ sourceVal ^ newVal) & 0x10) ? AF : 0;
+		flags |= (newVal & 0x8000) ? SF : 0;
+		flags |= newVal == 0 ? ZF : 0;
+		flags |= (((op == Add ? ~(oldDestVal ^ sourceVal) : (oldDestVal ^ sourceVal)) & (oldDestVal ^ newVal)) & 0x8000) ? OF : 0;
+
+		s.flags = static_cast<uint16_t>((s.flags & ~(CF | PF | AF | SF | ZF | OF)) | flags);
+	}
+
+	template <Operation op, typename T>
+	inline void Execute(State& s, T& dest, T source)
+	{
+		const uint16_t oldDestVal = dest;
+
+		if constexpr (op == Mov)
+		{
+			dest = source;
+		}
+		else if constexpr (op == Add)
+		{
+			dest += source;
+			SetFlags(s, op, dest, oldDestVal, source);
+		}
+		else if constexpr (op == Sub)
+		{
+			dest -= source;
+			SetFlags(s, op, dest, oldDestVal, source);
+		}
+		else
+		{
+			if constexpr (sizeof(T) == 1)
+			{
+				dest -= source;
+			}
+
+			SetFlags(s, op, static_cast<uint16_t>(dest - source), oldDestVal, source);
+		}
+	}
+
+	template <Operation op, typename T>
+	inline void ExecuteAt(State& s, uint32_t address, T source)
+	{
+		T dest = Load<T>(address);
+		Execute<op>(s, dest, source);
+		std::memcpy(&memory[address], &dest, sizeof(T));
+	}
+
+	inline bool Loop(State& s)
+	{
+		if (s.reg[1])
+		{
+			--s.reg[1];
+			return true;
+		}
+
+		return false;
+	}
+
+	inline bool LoopZ(State& s)
+	{
+		--s.reg[1];
+		return s.reg[1];
+	}
+
+	inline bool LoopNZ(State& s)
+	{
+		--s.reg[1];
+		return !(s.flags & ZF) && s.reg[1];
+	}
+}
+)";
+
+struct TranslatedBlock
+{
+	uint32_t endIp = 0;
+	std::vector<DecodedInstruction> instructions{};
+};
+
+static bool IsBranch(OpCode opCode)
+{
+	return opCode >= OpCode::op_je && opCode <= OpCode::op_jcxz;
+}
+
+static const char* BranchCondition(OpCode opCode)
+{
+	switch (opCode)
+	{
+	case OpCode::op_je: return "s.flags & ZF";
+	case OpCode::op_jl: return "s.flags & SF";
+	case OpCode::op_jle: return "s.flags & (ZF | SF)";
+	case OpCode::op_jb: return "s.flags & BF";
+	case OpCode::op_jbe: return "s.flags & (BF | ZF)";
+	case OpCode::op_jp: return "s.flags & PF";
+	case OpCode::op_jo: return "!(s.flags & OF)";
+	case OpCode::op_js: return "s.flags & SF";
+	case OpCode::op_jne: return "!(s.flags & ZF)";
+	case OpCode::op_jnl: return "!(s.flags & SF)";
+	case OpCode::op_jnle: return "!(s.flags & ZF) && (s.flags & SF)";
+	case OpCode::op_jnb: return "!(s.flags & BF)";
+	case OpCode::op_jnbe: return "!(s.flags & (BF | ZF))";
+	case OpCode::op_jnp: return "!(s.flags & PF)";
+	case OpCode::op_jno: return "!(s.flags & OF)";
+	case OpCode::op_jns: return "s.flags & SF";
+	case OpCode::op_loop: return "Loop(s)";
+	case OpCode::op_loopz: return "LoopZ(s)";
+	case OpCode::op_loopnz: return "LoopNZ(s)";
+	case OpCode::op_jcxz: return "!s.reg[1]";
+	default: return "false";
+	}
+}
+
+static const char* OperationName(OpCode opCode)
+{
+	switch (opCode)
+	{
+	case OpCode::op_mov: return "Mov";
+	case OpCode::op_add: return "Add";
+	case OpCode::op_sub: return "Sub";
+	default: return "Cmp";
+	}
+}
+
+static std::string Hex(uint32_t value)
+{
+	char text[16];
+	std::snprintf(text, sizeof(text), "0x%04x", value);
+	return text;
+}
+
+static std::string BlockName(uint32_t ip)
+{
+	char text[16];
+	std::snprintf(text, sizeof(text), "Block_%04x", ip);
+	return text;
+}
+
+static std::string AddressExpression(const EffectiveAddress& address)
+{
+	if (address.base == Register::reg_none && address.index == Register::reg_none)
+	{
+		return Hex(static_cast<uint16_t>(address.displacement));
+	}
+
+	std::string expression = "static_cast<uint16_t>(";
+	if (address.base != Register::reg_none)
+	{
+		expression += "s.reg[" + std::to_string(static_cast<int>(address.base)) + "]";
+	}
+
+	if (address.index != Register::reg_none)
+	{
+		expression += address.base != Register::reg_none ? " + " : "";
+		expression += "s.reg[" + std::to_string(static_cast<int>(address.index)) + "]";
+	}
+
+	if (address.displacement != 0)
+	{
+		expression += " + " + std::to_string(address.displacement);
+	}
+
+	return expression + ")";
+}
+
+static std::string RegisterExpression(const RegisterAccess& reg, bool bWord)
+{
+	const std::string index = std::to_string(static_cast<int>(reg.index));
+	return bWord ? "s.reg[" + index + "]" : "ByteRegister(s, " + index + ", " + std::to_string(reg.offset) + ")";
+}
+
+static std::string SourceExpression(const DecodedInstruction& decodedInst, const char* type)
+{
+	switch (decodedInst.SourceOT)
+	{
+	case OperandType::ot_register:
+	case OperandType::ot_accumulator:
+		return RegisterExpression(decodedInst.Source.reg, decodedInst.bWord);
+
+	case OperandType::ot_memory:
+		return std::string("Load<") + type + ">(" + AddressExpression(decodedInst.Source.address) + ")";
+
+	default:
+		return std::string("static_cast<") + type + ">(" + std::to_string(decodedInst.Source.immediate) + ")";
+	}
+}
+
+static void EmitInstruction(std::ostream& out, const DecodedInstruction& decodedInst)
+{
+	std::ostringstream disassembly;
+	disassembly << decodedInst;
+
+	// The simulator leaves everything alone for test and whatever else it doesn't execute.
+	if (decodedInst.opCode < OpCode::op_mov || decodedInst.opCode > OpCode::op_cmp)
+	{
+		out << "\t// " << disassembly.str() << '\n';
+		return;
+	}
+
+	const char* type = decodedInst.bWord ? "uint16_t" : "uint8_t";
+	const std::string source = SourceExpression(decodedInst, type);
+
+	out << '\t';
+	if (decodedInst.DestOT == OperandType::ot_memory)
+	{
+		out << "ExecuteAt<" << OperationName(decodedInst.opCode) << ", " << type << ">(s, " <<
+			AddressExpression(decodedInst.Dest.address) << ", " << source << ");";
+	}
+	else
+	{
+		out << "Execute<" << OperationName(decodedInst.opCode) << ", " << type << ">(s, " <<
+			RegisterExpression(decodedInst.Dest.reg, decodedInst.bWord) << ", " << source << ");";
+	}
+
+	out << " // " << disassembly.str() << '\n';
+}
+
+static void EmitBlock(std::ostream& out, uint32_t startIp, const TranslatedBlock& block)
+{
+	out << "\n// " << Hex(startIp) << " - " << Hex(block.endIp) << "\nstatic uint32_t " << BlockName(startIp) << "(State& s)\n{\n";
+
+	// Destination registers count as written the first time the block runs, like in the block engine.
+	std::string mutations{};
+	for (const DecodedInstruction& decodedInst : block.instructions)
+	{
+		if (decodedInst.opCode != OpCode::op_undefined && !IsBranch(decodedInst.opCode) &&
+			(decodedInst.DestOT == OperandType::ot_register || decodedInst.DestOT == OperandType::ot_accumulator))
+		{
+			mutations += "\t\tMutate(s, " + std::to_string(static_cast<int>(decodedInst.Dest.reg.index)) + ");\n";
+		}
+	}
+
+	if (!mutations.empty())
+	{
+		out << "\tstatic bool bEntered = false;\n\tif (!bEntered)\n\t{\n\t\tbEntered = true;\n" << mutations << "\t}\n\n";
+	}
+
+	for (const DecodedInstruction& decodedInst : block.instructions)
+	{
+		EmitInstruction(out, decodedInst);
+	}
+
+	const DecodedInstruction& last = block.instructions.back();
+	if (IsBranch(last.opCode))
+	{
+		const uint32_t takenIp = block.endIp + last.destTarget;
+		out << "\treturn (" << BranchCondition(last.opCode) << ") ? " << Hex(takenIp) << "u : " << Hex(block.endIp) << "u;\n}\n";
+	}
+	else
+	{
+		out << "\treturn " << Hex(block.endIp) << "u;\n}\n";
+	}
+}
+
+// Every block reachable from ip 0, keyed by start. A jump into the middle of a block starts a block of its own,
+// the instructions they share are translated twice.
+static std::map<uint32_t, TranslatedBlock> DiscoverBlocks(const VirtualChip& chip)
+{
+	std::map<uint32_t, TranslatedBlock> blocks{};
+	std::vector<uint32_t> pending{ 0 };
+
+	while (!pending.empty())
+	{
+		const uint32_t startIp = pending.back();
+		pending.pop_back();
+
+		if (startIp >= chip.m_programSize || blocks.count(startIp))
+		{
+			continue;
+		}
+
+		TranslatedBlock& block = blocks[startIp];
+		uint32_t ip = startIp;
+
+		while (ip < chip.m_programSize)
+		{
+			DecodedInstruction decodedInst;
+			Decoder::Disasm(chip, ip, decodedInst);
+
+			ip += static_cast<uint32_t>(decodedInst.extraBits + 1);
+			block.instructions.push_back(decodedInst);
+
+			if (IsBranch(decodedInst.opCode))
+			{
+				pending.push_back(ip + decodedInst.destTarget);
+				break;
+			}
+		}
+
+		block.endIp = ip;
+		pending.push_back(block.endIp);
+	}
+
+	return blocks;
+}
+
+static void EmitMain(std::ostream& out, VirtualChip& chip, const char* programName, const std::map<uint32_t, TranslatedBlock>& blocks)
+{
+	out << "\nint main()\n{\n\tState s{};\n\tuint32_t ip = 0;\n\n\twhile (ip < " << chip.m_programSize << "u)\n\t{\n\t\tswitch (ip)\n\t\t{\n";
+
+	for (const auto& [startIp, block] : blocks)
+	{
+		out << "\t\tcase " << Hex(startIp) << ": ip = " << BlockName(startIp) << "(s); break;\n";
+	}
+
+	out << "\t\tdefault:\n\t\t\tstd::fprintf(stderr, \"No translated block at ip 0x%04x\\n\", ip);\n\t\t\treturn 2;\n\t\t}\n\t}\n\n";
+
+	std::string name{};
+	for (const char* c = programName; *c; ++c)
+	{
+		name += (*c == '"' || *c == '\\') ? std::string("\\") + *c : std::string(1, *c);
+	}
+
+	out << "\tstd::printf(\"%s execution \\n\\nFinal registers:\\n\", \"" << name << "\");\n";
+	out << R"code(	for (uint8_t i = 0; i < s.mutatedCount; ++i)
+	{
+		const uint16_t value = s.reg[s.mutated[i]];
+		if (value != 0)
+		{
+			std::printf("      %s: 0x%04x (%d)\n", registerNames[s.mutated[i]], value, value);
+		}
+	}
+
+	std::printf("      ip:0x%04x (%d)", ip, static_cast<int32_t>(ip));
+	if (s.flags)
+	{
+		std::printf("\n  flags :");
+		for (int i = 0; i < 16; ++i)
+		{
+			if (s.flags & (1 << i))
+			{
+				std::printf("%c", flagSymbols[i]);
+			}
+		}
+	}
+
+	std::printf("\n");
+
+)code";
+
+	// The simulator stopped at its budget, so there is nothing the end of the program can be compared to.
+	if (chip.ip_register < chip.m_programSize)
+	{
+		out << "\t// sim8086 -translate stopped at its -limit budget before the program ended, there is no expected state.\n"
+			"\treturn 0;\n}\n";
+		return;
+	}
+
+	// What the simulator ends with on the same program.
+	out << "\tconst uint16_t expectedRegisters[8] = { ";
+	for (size_t i = 0; i < 8; ++i)
+	{
+		out << Hex(chip[i]) << (i < 7 ? ", " : " };\n");
+	}
+
+	out << "\tconst uint8_t expectedMutated[] = { ";
+	for (uint8_t i = 0; i < chip.m_registers.mutatedCount; ++i)
+	{
+		out << static_cast<int>(chip.m_registers.mutated[i]) << ", ";
+	}
+
+	out << "8 };\n\tconst uint16_t expectedFlags = " << Hex(static_cast<uint16_t>(Simulator::GetFlags(chip).to_ulong())) <<
+		";\n\tconst uint32_t expectedIp = " << Hex(chip.ip_register) << "u;\n";
+
+	out << R"code(
+	bool bMatches = s.flags == expectedFlags && ip == expectedIp && s.mutatedCount == sizeof(expectedMutated) - 1;
+	for (int i = 0; i < 8; ++i)
+	{
+		bMatches = bMatches && s.reg[i] == expectedRegisters[i] && (i >= s.mutatedCount || s.mutated[i] == expectedMutated[i]);
+	}
+
+	if (!bMatches)
+	{
+		std::fprintf(stderr, "Translated program diverged from sim8086 -exec\n");
+		return 1;
+	}
+
+	return 0;
+}
+)code";
+}
+
+bool Translator::Translate(VirtualChip& chip, std::ostream& out, const char* programName, uint64_t instructionLimit)
+{
+	const std::map<uint32_t, TranslatedBlock> blocks = DiscoverBlocks(chip);
+
+	out << "// " << programName << " translated by sim8086 -translate. Build with a C++17 compiler, e.g. c++ -O2 -std=c++17.\n\n";
+	out << prelude;
+
+	for (const auto& [startIp, block] : blocks)
+	{
+		EmitBlock(out, startIp, block);
+	}
+
+	// The block engine ends in the same state as -exec and gets there much faster.
+	Jit jit{};
+
+	BlockEngine blockEngine(chip);
+	blockEngine.jit = &jit;
+	blockEngine.instructionLimit = instructionLimit;
+	blockEngine.Run();
+
+	EmitMain(out, chip, programName, blocks);
+
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+struct VirtualChip;
+
+namespace Translator
+{
+	// Writes the program loaded into chip as a self-contained C++ file: one function per basic block,
+	// guest registers and flags in a struct the blocks share, memory as a plain array. The generated main
+	// prints the final registers the way -exec does and exits with 1 when they differ from what the
+	// simulator computed while translating. Runs the program to completion, so chip is left spent, or
+	// for about instructionLimit instructions. Stopped short, chip's ip is still in the program and the
+	// generated main has nothing to compare with.
+	bool Translate(VirtualChip& chip, std::ostream& out, const char* programName, uint64_t instructionLimit = UINT64_MAX);
+}
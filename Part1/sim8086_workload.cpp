@@ -0,0 +1,240 @@
+#include <charconv>
+#include <iterator>
+
+#include "sim8086_workload.h"
+
+// Indices into the instruction weights, in WorkloadMix order.
+enum Operation : size_t
+{
+	operation_mov,
+	operation_add,
+	operation_sub,
+	operation_cmp,
+	operation_test,
+	operation_branch,
+	operation_count
+};
+
+// First byte of op reg/mem, reg with d = 0 and w = 0.
+static constexpr uint8_t regMemOpcode[operation_branch]{ 0x88, 0x00, 0x28, 0x38, 0x84 };
+// First byte of op acc, immediate with w = 0.
+static constexpr uint8_t accumulatorOpcode[operation_branch]{ 0xb0, 0x04, 0x2c, 0x3c, 0xa8 };
+// reg field selecting the operation in the immediate groups.
+static constexpr uint8_t groupReg[operation_branch]{ 0, 0, 5, 7, 0 };
+
+// Registers a body may write: everything but cx and sp, or cl and ch.
+static constexpr uint8_t writableWord[]{ 0, 2, 3, 5, 6, 7 };
+static constexpr uint8_t writableByte[]{ 0, 2, 3, 4, 6, 7 };
+
+bool WorkloadMix::Set(std::string_view keyValue)
+{
+	const size_t separator = keyValue.find('=');
+	if (separator == std::string_view::npos)
+	{
+		return false;
+	}
+
+	const std::string_view key = keyValue.substr(0, separator);
+	const std::string_view value = keyValue.substr(separator + 1);
+
+	uint32_t* weight = key == "mov" ? &mov : key == "add" ? &add : key == "sub" ? &sub : key == "cmp" ? &cmp :
+		key == "test" ? &test : key == "branch" ? &branch : key == "reg" ? &registers : key == "imm" ? &immediates :
+		key == "mem" ? &memory : key == "direct" ? &direct : key == "byte" ? &bytePercent : nullptr;
+
+	return weight && std::from_chars(value.data(), value.data() + value.size(), *weight).ec == std::errc{};
+}
+
+WorkloadGenerator::WorkloadGenerator(uint32_t seed)
+	: m_random(seed)
+{
+}
+
+std::vector<uint8_t> WorkloadGenerator::Generate(const WorkloadMix& mix, uint32_t bodyInstructions, uint16_t iterations)
+{
+	std::vector<uint8_t> program{};
+	uint32_t generated = 0;
+
+	while (generated < bodyInstructions)
+	{
+		// mov cx, iterations
+		program.push_back(0xb9);
+		program.push_back(static_cast<uint8_t>(iterations));
+		program.push_back(static_cast<uint8_t>(iterations >> 8));
+
+		const size_t bodyStart = program.size();
+
+		// A body may end up to one branch and its instruction, 8 bytes, past maxBodySize.
+		while (generated < bodyInstructions && program.size() - bodyStart < maxBodySize)
+		{
+			const size_t before = program.size();
+			AppendInstruction(mix, program);
+			generated += program[before] >= 0x70 && program[before] <= 0x7f ? 2 : 1;
+		}
+
+		// loop bodyStart
+		program.push_back(0xe2);
+		program.push_back(static_cast<uint8_t>(static_cast<int>(bodyStart) - static_cast<int>(program.size() + 1)));
+	}
+
+	return program;
+}
+
+void WorkloadGenerator::AppendInstruction(const WorkloadMix& mix, std::vector<uint8_t>& out)
+{
+	const uint32_t operationWeights[]{ mix.mov, mix.add, mix.sub, mix.cmp, mix.test, mix.branch };
+	const uint32_t formWeights[]{ mix.registers, mix.immediates, mix.memory, mix.direct };
+
+	std::discrete_distribution<size_t> operations(std::begin(operationWeights), std::end(operationWeights));
+	std::discrete_distribution<size_t> forms(std::begin(formWeights), std::end(formWeights));
+
+	size_t operation = operations(m_random);
+
+	if (operation == operation_branch)
+	{
+		// jcc over the next instruction, whichever way the flags happen to be.
+		std::vector<uint8_t> skipped{};
+		do
+		{
+			operation = operations(m_random);
+		} while (operation == operation_branch);
+
+		AppendOperation(operation, static_cast<OperandForm>(forms(m_random)), IsWord(mix), skipped);
+
+		out.push_back(static_cast<uint8_t>(0x70 + std::uniform_int_distribution<int>(0, 15)(m_random)));
+		out.push_back(static_cast<uint8_t>(skipped.size()));
+		out.insert(out.end(), skipped.begin(), skipped.end());
+		return;
+	}
+
+	AppendOperation(operation, static_cast<OperandForm>(forms(m_random)), IsWord(mix), out);
+}
+
+void WorkloadGenerator::AppendOperation(size_t operation, OperandForm form, bool bWord, std::vector<uint8_t>& out)
+{
+	const uint8_t w = bWord ? 1 : 0;
+
+	if (form == OperandForm::registers)
+	{
+		out.push_back(regMemOpcode[operation] | w);
+		out.push_back(static_cast<uint8_t>(0b11000000 | AnyRegister() << 3 | WritableRegister(bWord)));
+		return;
+	}
+
+	if (form == OperandForm::immediate)
+	{
+		const uint8_t reg = WritableRegister(bWord);
+
+		if (operation == operation_mov)
+		{
+			out.push_back(static_cast<uint8_t>(0xb0 | w << 3 | reg));
+			AppendImmediate(bWord, out);
+		}
+		else if (reg == 0 && m_random() % 2 == 0)
+		{
+			out.push_back(accumulatorOpcode[operation] | w);
+			AppendImmediate(bWord, out);
+		}
+		else
+		{
+			// 0x83 sign extends a byte immediate to a word.
+			const bool bSigned = operation != operation_test && bWord && m_random() % 2 == 0;
+			const uint8_t group = operation == operation_test ? 0xf6 : 0x80;
+
+			out.push_back(static_cast<uint8_t>(group | (bSigned ? 0b10 : 0) | w));
+			out.push_back(static_cast<uint8_t>(0b11000000 | groupReg[operation] << 3 | reg));
+			AppendImmediate(bWord && !bSigned, out);
+		}
+
+		return;
+	}
+
+	// A quarter of the memory operands take an immediate, the rest a register, loaded or stored.
+	const uint32_t shape = m_random() % 4;
+
+	if (shape == 0)
+	{
+		const uint8_t opcode = operation == operation_mov ? 0xc6 : operation == operation_test ? 0xf6 : 0x80;
+
+		out.push_back(opcode | w);
+		AppendMemoryOperand(groupReg[operation], form, out);
+		AppendImmediate(bWord, out);
+		return;
+	}
+
+	// test has no d bit.
+	const bool bRegIsDest = operation != operation_test && shape == 1;
+
+	if (operation == operation_mov && form == OperandForm::direct && m_random() % 2 == 0)
+	{
+		// mov al/ax, [addr] and mov [addr], al/ax
+		const uint16_t address = static_cast<uint16_t>(m_random());
+
+		out.push_back(static_cast<uint8_t>((bRegIsDest ? 0xa0 : 0xa2) | w));
+		out.push_back(static_cast<uint8_t>(address));
+		out.push_back(static_cast<uint8_t>(address >> 8));
+		return;
+	}
+
+	out.push_back(static_cast<uint8_t>(regMemOpcode[operation] | (bRegIsDest ? 0b10 : 0) | w));
+	AppendMemoryOperand(bRegIsDest ? WritableRegister(bWord) : AnyRegister(), form, out);
+}
+
+bool WorkloadGenerator::IsWord(const WorkloadMix& mix)
+{
+	return std::uniform_int_distribution<uint32_t>(0, 99)(m_random) >= mix.bytePercent;
+}
+
+uint8_t WorkloadGenerator::WritableRegister(bool bWord)
+{
+	const uint8_t* registers = bWord ? writableWord : writableByte;
+	return registers[m_random() % std::size(writableWord)];
+}
+
+uint8_t WorkloadGenerator::AnyRegister()
+{
+	return static_cast<uint8_t>(m_random() % 8);
+}
+
+// mod reg r/m byte and displacement of a memory operand.
+void WorkloadGenerator::AppendMemoryOperand(uint8_t reg, OperandForm form, std::vector<uint8_t>& out)
+{
+	uint8_t mod = 0;
+	uint8_t rm = 0b110;
+
+	if (form == OperandForm::memory)
+	{
+		mod = static_cast<uint8_t>(m_random() % 3);
+		rm = static_cast<uint8_t>(m_random() % 8);
+
+		// mod 00 with r/m 110 is the direct address.
+		if (mod == 0 && rm == 0b110)
+		{
+			mod = 1;
+		}
+	}
+
+	out.push_back(static_cast<uint8_t>(mod << 6 | reg << 3 | rm));
+
+	const uint16_t displacement = static_cast<uint16_t>(m_random());
+
+	if (mod == 1)
+	{
+		out.push_back(static_cast<uint8_t>(displacement));
+	}
+	else if (mod == 2 || form == OperandForm::direct)
+	{
+		out.push_back(static_cast<uint8_t>(displacement));
+		out.push_back(static_cast<uint8_t>(displacement >> 8));
+	}
+}
+
+void WorkloadGenerator::AppendImmediate(bool bWord, std::vector<uint8_t>& out)
+{
+	const uint16_t immediate = static_cast<uint16_t>(m_random());
+
+	out.push_back(static_cast<uint8_t>(immediate));
+	if (bWord)
+	{
+		out.push_back(static_cast<uint8_t>(immediate >> 8));
+	}
+}
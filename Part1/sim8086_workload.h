@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// Relative weights of what a synthetic program is made of, zero leaves something out entirely.
+struct WorkloadMix
+{
+	// Instructions. branch is a conditional jump over the instruction after it.
+	uint32_t mov = 4;
+	uint32_t add = 2;
+	uint32_t sub = 1;
+	uint32_t cmp = 2;
+	uint32_t test = 1;
+	uint32_t branch = 1;
+
+	// Operands: register to register, immediate, memory addressed through registers and direct address.
+	uint32_t registers = 4;
+	uint32_t immediates = 2;
+	uint32_t memory = 2;
+	uint32_t direct = 1;
+
+	// Share of byte rather than word operands.
+	uint32_t bytePercent = 25;
+
+	// Sets the weight named by key from "key=value", false if there is no such key.
+	bool Set(std::string_view keyValue);
+};
+
+// Random but deterministic instruction streams for benchmarking, made only of what the decoder understands.
+// The program is a run of loops: mov cx, iterations, then a body of short straight line code with forward
+// branches, then loop back. Nothing in a body writes cx or sp.
+class WorkloadGenerator
+{
+public:
+	explicit WorkloadGenerator(uint32_t seed);
+
+	// At least bodyInstructions instructions over all loop bodies, each body running iterations times.
+	std::vector<uint8_t> Generate(const WorkloadMix& mix, uint32_t bodyInstructions, uint16_t iterations);
+
+	// Bodies stop growing past this many bytes, well within what loop can branch back over.
+	static constexpr size_t maxBodySize = 112;
+
+private:
+	enum class OperandForm : uint8_t
+	{
+		registers,
+		immediate,
+		memory,
+		direct
+	};
+
+	void AppendInstruction(const WorkloadMix& mix, std::vector<uint8_t>& out);
+	void AppendOperation(size_t operation, OperandForm form, bool bWord, std::vector<uint8_t>& out);
+
+	bool IsWord(const WorkloadMix& mix);
+	uint8_t WritableRegister(bool bWord);
+	uint8_t AnyRegister();
+	void AppendMemoryOperand(uint8_t reg, OperandForm form, std::vector<uint8_t>& out);
+	void AppendImmediate(bool bWord, std::vector<uint8_t>& out);
+
+	std::mt19937 m_random;
+};
@@ -0,0 +1,98 @@
+/* Checks libsim8086 from C: sim8086_run has to end where sim8086_step does given the same calls, also when the cpu
+ * changes between them. Prints what differs and fails if anything does. */
+
+#include <stdio.h>
+
+#include "sim8086_capi.h"
+
+/* mov bx, 1000 / mov cx, 50000 / add [bx], ax / add ax, [bx + 2] / loop back. Word transfers at even addresses,
+ * which only the 8088 charges extra for. */
+static const uint8_t program[] = {
+	0xBB, 0xE8, 0x03,
+	0xB9, 0x50, 0xC3,
+	0x01, 0x07,
+	0x03, 0x47, 0x02,
+	0xE2, 0xF9
+};
+
+typedef sim8086_status (*Execute)(sim8086_context* context, uint64_t count, uint64_t* executed);
+
+/* Runs count instructions on cpu and the rest of the program on the other one, returns the instructions executed.
+ * before is how many ran on cpu. */
+static uint64_t RunSwitching(sim8086_context* context, Execute execute, uint64_t count, sim8086_cpu cpu, uint64_t* before)
+{
+	uint64_t executed = 0;
+	uint64_t total = 0;
+
+	sim8086_set_cpu(context, cpu);
+	sim8086_load(context, program, sizeof(program));
+
+	execute(context, count, &executed);
+	total += executed;
+	*before = executed;
+
+	sim8086_set_cpu(context, cpu == SIM8086_CPU_8086 ? SIM8086_CPU_8088 : SIM8086_CPU_8086);
+
+	do
+	{
+		execute(context, 100000, &executed);
+		total += executed;
+	} while (executed > 0);
+
+	return total;
+}
+
+int main(void)
+{
+	static const uint64_t counts[] = { 1, 4, 1000, 60001, 150002 };
+	int failures = 0;
+
+	sim8086_context* run = sim8086_create();
+	sim8086_context* step = sim8086_create();
+	if (!run || !step)
+	{
+		printf("sim8086_create failed\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	{
+		for (int cpu = SIM8086_CPU_8086; cpu <= SIM8086_CPU_8088; ++cpu)
+		{
+			uint64_t executed = 0;
+			uint64_t stepped = 0;
+
+			/* Blocks only stop between them, stepping switches wherever the run did. */
+			const uint64_t runTotal = RunSwitching(run, sim8086_run, counts[i], (sim8086_cpu)cpu, &executed);
+			const uint64_t stepTotal = RunSwitching(step, sim8086_step, executed, (sim8086_cpu)cpu, &stepped);
+
+			if (runTotal != stepTotal || sim8086_clocks(run) != sim8086_clocks(step))
+			{
+				printf("switching from cpu %d after %llu: run %llu instructions %llu clocks, step %llu instructions %llu clocks\n",
+					cpu, (unsigned long long)executed, (unsigned long long)runTotal, (unsigned long long)sim8086_clocks(run),
+					(unsigned long long)stepTotal, (unsigned long long)sim8086_clocks(step));
+				++failures;
+			}
+
+			for (int reg = SIM8086_REG_AX; reg <= SIM8086_REG_FLAGS; ++reg)
+			{
+				uint16_t runValue = 0;
+				uint16_t stepValue = 0;
+				sim8086_read_register(run, (sim8086_register)reg, &runValue);
+				sim8086_read_register(step, (sim8086_register)reg, &stepValue);
+
+				if (runValue != stepValue)
+				{
+					printf("switching from cpu %d after %llu: register %d is 0x%04x after run, 0x%04x after step\n",
+						cpu, (unsigned long long)executed, reg, runValue, stepValue);
+					++failures;
+				}
+			}
+		}
+	}
+
+	sim8086_destroy(run);
+	sim8086_destroy(step);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// Writes memory dumps in every DumpFormat and reads them back with ReadMemoryDump, which has to give m_memory again.
+// Memory is what a workload generator program leaves behind, plus a page of runs and literals of every length the
+// compressed format encodes differently. Run in an empty directory, the dumps go to the working directory.
+// Prints what differs and fails if anything does.
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "sim8086_blocks.h"
+#include "sim8086_decoder.h"
+#include "sim8086_dump.h"
+#include "sim8086_loader.h"
+#include "sim8086_workload.h"
+
+// Runs of 1 to 140 equal bytes, each run a different value than the one before, then bytes that never repeat.
+static void FillRuns(VirtualChip& chip, size_t start, size_t size)
+{
+	size_t index = start;
+	uint8_t value = 1;
+	for (size_t run{ 1 }; index < start + size / 2; run = run % 140 + 1, ++value)
+	{
+		for (size_t i{ 0 }; i < run && index < start + size / 2; ++i)
+		{
+			chip.m_memory[index++] = value;
+		}
+	}
+
+	for (; index < start + size; ++index)
+	{
+		chip.m_memory[index] = static_cast<uint8_t>(index * 7 + 1);
+	}
+
+	chip.MarkDirty(start, size);
+}
+
+int main()
+{
+	const char* formatNames[]{ "raw", "sparse", "compressed" };
+	int failures = 0;
+
+	WorkloadMix mix{};
+	mix.Set("mem=6");
+	mix.Set("direct=3");
+
+	WorkloadGenerator generator(7);
+	std::vector<uint8_t> program = generator.Generate(mix, 400, 50);
+
+	const size_t programSize = program.size();
+	program.resize(programSize + ProgramImage::padding);
+
+	VirtualChip chip{};
+	chip.m_program = program.data();
+	chip.m_programSize = programSize;
+
+	BlockEngine blockEngine(chip);
+	blockEngine.Run();
+
+	FillRuns(chip, 0x20000, MemoryDumper::pageSize);
+
+	// Written to, but zeros again, which sparse dumps leave out.
+	chip.MarkDirty(0x30000, 2);
+
+	for (const std::filesystem::path& path : std::filesystem::directory_iterator(std::filesystem::current_path()))
+	{
+		if (path.filename().string().rfind("sim8086_memory_", 0) == 0)
+		{
+			std::filesystem::remove(path);
+		}
+	}
+
+	for (DumpFormat format : { DumpFormat::raw, DumpFormat::sparse, DumpFormat::compressed })
+	{
+		MemoryDumper dumper(format);
+		dumper.Submit(chip);
+		dumper.Finish();
+	}
+
+	const std::string filePaths[]{ "sim8086_memory_0.data", "sim8086_memory_0.sparse", "sim8086_memory_1.sparse" };
+	for (size_t i{ 0 }; i < 3; ++i)
+	{
+		std::vector<uint8_t> memory{};
+		if (!ReadMemoryDump(filePaths[i].c_str(), memory))
+		{
+			std::printf("%s dump %s could not be read back\n", formatNames[i], filePaths[i].c_str());
+			++failures;
+		}
+		else if (memory != chip.m_memory)
+		{
+			std::printf("%s dump %s reads back different from memory\n", formatNames[i], filePaths[i].c_str());
+			++failures;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
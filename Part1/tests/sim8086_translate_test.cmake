@@ -0,0 +1,51 @@
+# Translates a workload generator program with sim8086 -translate, builds and runs the result and checks it ends with
+# the final registers sim8086 -exec shows for the same program. The generated main also fails on its own when it
+# disagrees with the simulator.
+#
+# cmake -DSIM8086=... -DBENCH=... -DCXX=... -DWORK_DIR=... -DSEED=... -DMIX=... -P sim8086_translate_test.cmake
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(program ${WORK_DIR}/workload_${SEED}.bin)
+set(translation ${WORK_DIR}/workload_${SEED}.cpp)
+set(translated ${WORK_DIR}/workload_${SEED}${CMAKE_EXECUTABLE_SUFFIX})
+
+# The bench writes the program before it measures, one short run is enough.
+execute_process(COMMAND ${BENCH} -seed ${SEED} -instructions 400 -iterations 300 -runs 1 -mix ${MIX} -save ${program}
+    OUTPUT_QUIET RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "sim8086_bench could not generate ${program}")
+endif()
+
+execute_process(COMMAND ${SIM8086} -translate ${translation} ${program} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "sim8086 -translate failed on ${program}")
+endif()
+
+execute_process(COMMAND ${CXX} -std=c++17 -O1 ${translation} -o ${translated} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${translation} does not compile")
+endif()
+
+execute_process(COMMAND ${translated} OUTPUT_VARIABLE translatedOutput RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${translated} does not end where the simulator did:\n${translatedOutput}")
+endif()
+
+execute_process(COMMAND ${SIM8086} -exec ${program} OUTPUT_VARIABLE execOutput RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "sim8086 -exec failed on ${program}")
+endif()
+
+# Only the final register blocks, -exec traces every instruction before it.
+string(FIND "${translatedOutput}" "Final registers:" translatedStart)
+string(FIND "${execOutput}" "Final registers:" execStart REVERSE)
+if(translatedStart EQUAL -1 OR execStart EQUAL -1)
+    message(FATAL_ERROR "No final registers to compare:\n${translatedOutput}")
+endif()
+
+string(SUBSTRING "${translatedOutput}" ${translatedStart} -1 translatedOutput)
+string(SUBSTRING "${execOutput}" ${execStart} -1 execOutput)
+
+if(NOT translatedOutput STREQUAL execOutput)
+    message(FATAL_ERROR "${translated} ends with\n${translatedOutput}\nsim8086 -exec with\n${execOutput}")
+endif()